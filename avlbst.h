@@ -6,14 +6,22 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
+#include <memory>
+#include <new>
+#include <functional>
+#include <atomic>
+#include <stdexcept>
 #include "bst.h"
+#include "bloomfilter.h"
 
 struct KeyError { };
 
 /**
-* A special kind of node for an AVL tree, which adds the balance as a data member, plus
-* other additional helper functions. You do NOT need to implement any functionality or
-* add additional data members or helper functions.
+* A special kind of node for an AVL tree, which adds the balance plus other additional
+* helper functions. The balance (-2..2, the +-2 states only exist mid-rotation) is kept
+* biased by 2 in the tag bits of the parent pointer, so an AVLNode is no larger than a
+* plain Node.
 */
 template <typename Key, typename Value>
 class AVLNode : public Node<Key, Value>
@@ -22,6 +30,7 @@ public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
     virtual ~AVLNode();
+    virtual AVLNode<Key, Value>* clone() const override;
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
@@ -36,7 +45,7 @@ public:
     virtual AVLNode<Key, Value>* getRight() const override;
 
 protected:
-    int8_t balance_;    // effectively a signed char
+    static const int8_t BALANCE_BIAS = 2;
 };
 
 /*
@@ -50,8 +59,9 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent)
 {
+    setBalance(0);
 
 }
 
@@ -64,13 +74,24 @@ AVLNode<Key, Value>::~AVLNode()
 
 }
 
+/**
+* Returns an unlinked copy, keeping the balance.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLNode<Key, Value>::clone() const
+{
+    AVLNode<Key, Value>* copy = new AVLNode<Key, Value>(this->getKey(), this->getValue(), nullptr);
+    copy->copyStateFrom(*this);
+    return copy;
+}
+
 /**
 * A getter for the balance of a AVLNode.
 */
 template<class Key, class Value>
 int8_t AVLNode<Key, Value>::getBalance() const
 {
-    return balance_;
+    return static_cast<int8_t>(this->getTag()) - BALANCE_BIAS;
 }
 
 /**
@@ -79,7 +100,7 @@ int8_t AVLNode<Key, Value>::getBalance() const
 template<class Key, class Value>
 void AVLNode<Key, Value>::setBalance(int8_t balance)
 {
-    balance_ = balance;
+    this->setTag(static_cast<uintptr_t>(balance + BALANCE_BIAS));
 }
 
 /**
@@ -88,7 +109,7 @@ void AVLNode<Key, Value>::setBalance(int8_t balance)
 template<class Key, class Value>
 void AVLNode<Key, Value>::updateBalance(int8_t diff)
 {
-    balance_ += diff;
+    setBalance(getBalance() + diff);
 }
 
 /**
@@ -98,7 +119,7 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
 }
 
 /**
@@ -107,7 +128,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->left_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getLeft());
 }
 
 /**
@@ -127,21 +148,340 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
+/**
+* An AVL tree. In relaxed mode (setRelaxed(true)) insert and remove skip the
+* retracing and rotations altogether and balances go stale; the height is
+* instead kept within 3 log2 n by rebuilding the subtree above an overly
+* deep insertion (scapegoat style). rebalance(), or leaving relaxed
+* mode, rebuilds the whole tree into a valid AVL tree in O(n).
+*
+* With lazy removal (setLazyRemove(true)) remove only marks the node as a
+* tombstone, which find, operator[] and the iterator skip. Once tombstones
+* exceed the given fraction of all nodes, compact() unlinks them all and
+* rebuilds the tree in a single O(n) pass.
+*
+* With a bloom filter (setBloomFilter(true)) find, operator[] and remove
+* first test the key against a blocked bloom filter of the live keys and
+* return at once, after about one cache miss, if it was never added. The
+* filter grows with the tree and is rebuilt from the live keys once
+* removals reach a quarter of the keys it holds, since a bloom filter
+* cannot forget a key. Keys then need std::hash.
+*/
 template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    /**
+    * Owns a node extracted from an AVLTree, so that it can be inserted into
+    * another AVLTree without reallocating it or copying its key and value.
+    * Frees the node if it is never inserted.
+    */
+    class NodeHandle
+    {
+    public:
+        NodeHandle();
+        NodeHandle(NodeHandle&& other);
+        NodeHandle& operator=(NodeHandle&& other);
+        ~NodeHandle();
+
+        bool empty() const;
+        const Key& key() const;
+        Value& value() const;
+
+    protected:
+        friend class AVLTree<Key, Value>;
+        explicit NodeHandle(AVLNode<Key, Value>* node);
+        NodeHandle(const NodeHandle&) = delete;
+        NodeHandle& operator=(const NodeHandle&) = delete;
+        AVLNode<Key, Value>* node_;
+    };
+
+    AVLTree();
+    AVLTree(const AVLTree<Key, Value>& other);
+    AVLTree(AVLTree<Key, Value>&& other) noexcept;
+    AVLTree<Key, Value>& operator=(const AVLTree<Key, Value>& other);
+    AVLTree<Key, Value>& operator=(AVLTree<Key, Value>&& other) noexcept;
+    virtual ~AVLTree();
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    void insert(NodeHandle&& handle);
     virtual void remove(const Key& key);  // TODO
+    iterator erase(iterator pos);
+    NodeHandle extract(const Key& key);
+    NodeHandle extract(iterator pos);
+    void merge(AVLTree<Key, Value>&& other);
+    template<typename InputIt>
+    void insertSorted(InputIt first, InputIt last);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    void setRelaxed(bool relaxed);
+    bool isRelaxed() const;
+    void rebalance();
+    void setLazyRemove(bool lazy, double maxTombstoneRatio = 0.25);
+    bool isLazyRemove() const;
+    size_t tombstoneCount() const;
+    void compact();
+    void defragment();
+    iterator defragment(iterator first, size_t maxNodes);
+    void setBloomFilter(bool enabled, double falsePositiveRate = 0.01);
+    bool hasBloomFilter() const;
+    size_t bloomSkips() const;
+    size_t bloomBytes() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
 protected:
+    /**
+    * A block of memory that defragment laid nodes out in, in key order.
+    * Its slots are not reused; it is freed when its last node is destroyed.
+    */
+    struct NodeArena
+    {
+        char* begin;
+        char* end;
+        size_t live;      // nodes still in it
+    };
+
+    /**
+    * State that most trees never use, kept out of line so that an AVLTree
+    * stays small: the bloom filter and the arenas defragment made. It is
+    * allocated on first use and stays null otherwise.
+    */
+    struct Extras
+    {
+        Extras();
+        Extras(const Extras& other);  // copies the filter, not the arenas
+
+        std::vector<NodeArena> arenas;  // sorted by address
+        BloomFilter bloom;
+        uint64_t (*bloomHash)(const Key&);  // nullptr without a bloom filter
+        double bloomFalsePositiveRate;
+        size_t bloomCapacity;  // keys the filter was sized for
+        size_t bloomRemoved;   // removals since the filter was last built
+        std::atomic<size_t> bloomSkips;
+    };
+
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual void subtreeChanged(AVLNode<Key, Value>* node);
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) const;
+    virtual AVLNode<Key, Value>* copyNode(const AVLNode<Key, Value>& node, void* block) const;
+    virtual size_t nodeSize() const;
 
     // Add helper functions here
-    void rotateLeft(AVLNode<Key, Value>* head);
-    void rotateRight(AVLNode<Key, Value>* head);
+    AVLNode<Key, Value>* findSlot(const Key& key, AVLNode<Key, Value>*& parent, size_t& depth) const;
+    void reviveWith(AVLNode<Key, Value>* node, const Value& value);
+    void linkNode(AVLNode<Key, Value>* currNode, AVLNode<Key, Value>* parent, size_t depth);
+    void removeNode(AVLNode<Key, Value>* currNode);
+    void mergeLinear(AVLTree<Key, Value>& other);
+    static void collectInOrder(AVLNode<Key, Value>* subRoot, std::vector<AVLNode<Key, Value>*>& out);
+    static void cutForWalk(AVLNode<Key, Value>* currNode, size_t levels,
+        std::vector<std::pair<AVLNode<Key, Value>*, bool> >& parts);
+    void detach(AVLNode<Key, Value>* currNode);
+    void relocate(AVLNode<Key, Value>* node, void* block);
+    char* newArena(size_t capacity);
+    void adoptArenas(AVLTree<Key, Value>& other);
+    void destroyNode(AVLNode<Key, Value>* node);
+    static bool addressBefore(char* address, const NodeArena& arena);
+    virtual void destroyHelper(Node<Key, Value>* currNode) override;
     bool rotateP(AVLNode<Key, Value>* p, AVLNode<Key, Value>* c);
+    void relaxedInserted(AVLNode<Key, Value>* node, size_t depth);
+    AVLNode<Key, Value>* rebuild(AVLNode<Key, Value>* subRoot);
+    AVLNode<Key, Value>* buildBalanced(std::vector<AVLNode<Key, Value>*>& nodes,
+        size_t lo, size_t hi, AVLNode<Key, Value>* parent, int& height);
+    static size_t subtreeSize(Node<Key, Value>* currNode);
+    Extras& extras();
+    bool hasArenas() const;
+    bool bloomExcludes(const Key& key) const;
+    void bloomAdd(const Key& key);
+    void bloomRemoved();
+    void rebuildBloom();
+
+    bool relaxed_;
+    bool lazy_;
+    double maxTombstoneRatio_;
+    size_t size_;       // live entries
+    size_t maxSize_;    // peak size_ since the last full rebuild
+    size_t tombstones_;
+    std::unique_ptr<Extras> extras_;
+
+    // merge rebuilds both trees once the smaller holds 1/LINEAR_MERGE_RATIO of the larger
+    static const size_t LINEAR_MERGE_RATIO = 4;
+    static const size_t MIN_BLOOM_CAPACITY = 1024;
 };
 
+/*
+  ---------------------------------------------------------
+  Begin implementations for the AVLTree::NodeHandle class.
+  ---------------------------------------------------------
+*/
+
+/**
+* A default constructor for an empty handle.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::NodeHandle::NodeHandle() :
+    node_(nullptr)
+{
+
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>::NodeHandle::NodeHandle(AVLNode<Key, Value>* node) :
+    node_(node)
+{
+
+}
+
+/**
+* Takes the node from other, leaving it empty.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::NodeHandle::NodeHandle(NodeHandle&& other) :
+    node_(other.node_)
+{
+  other.node_ = nullptr;
+}
+
+template<class Key, class Value>
+typename AVLTree<Key, Value>::NodeHandle& AVLTree<Key, Value>::NodeHandle::operator=(NodeHandle&& other)
+{
+  if (this != &other)
+  {
+    delete node_;
+    node_ = other.node_;
+    other.node_ = nullptr;
+  }
+  return *this;
+}
+
+/**
+* Frees the node if the handle still owns one.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::NodeHandle::~NodeHandle()
+{
+  delete node_;
+}
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::NodeHandle::empty() const
+{
+  return node_ == nullptr;
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value>
+const Key& AVLTree<Key, Value>::NodeHandle::key() const
+{
+  return node_->getKey();
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value>
+Value& AVLTree<Key, Value>::NodeHandle::value() const
+{
+  return node_->getValue();
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the AVLTree::NodeHandle class.
+  -------------------------------------------------------
+*/
+
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree() :
+    relaxed_(false), lazy_(false), maxTombstoneRatio_(0.25),
+    size_(0), maxSize_(0), tombstones_(0)
+{
+
+}
+
+/**
+* An O(n) structural copy: the shape, balances, tombstones, mode settings
+* and bloom filter are all copied, with no rebalancing.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(const AVLTree<Key, Value>& other) :
+    BinarySearchTree<Key, Value>(other),
+    relaxed_(other.relaxed_), lazy_(other.lazy_), maxTombstoneRatio_(other.maxTombstoneRatio_),
+    size_(other.size_), maxSize_(other.maxSize_), tombstones_(other.tombstones_),
+    extras_(other.hasBloomFilter() ? new Extras(*other.extras_) : nullptr)
+{
+
+}
+
+/**
+* Takes other's nodes, settings and bloom filter in O(1). other is left
+* empty, with its mode settings unchanged and no bloom filter.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(AVLTree<Key, Value>&& other) noexcept :
+    BinarySearchTree<Key, Value>(std::move(other)),
+    relaxed_(other.relaxed_), lazy_(other.lazy_), maxTombstoneRatio_(other.maxTombstoneRatio_),
+    size_(other.size_), maxSize_(other.maxSize_), tombstones_(other.tombstones_),
+    extras_(std::move(other.extras_))
+{
+  other.size_ = 0;
+  other.maxSize_ = 0;
+  other.tombstones_ = 0;
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>& AVLTree<Key, Value>::operator=(const AVLTree<Key, Value>& other)
+{
+  if (this != &other)
+  {
+    BinarySearchTree<Key, Value>::operator=(other);
+    relaxed_ = other.relaxed_;
+    lazy_ = other.lazy_;
+    maxTombstoneRatio_ = other.maxTombstoneRatio_;
+    size_ = other.size_;
+    maxSize_ = other.maxSize_;
+    tombstones_ = other.tombstones_;
+    //clearing the old nodes above freed all of our arenas
+    extras_.reset(other.hasBloomFilter() ? new Extras(*other.extras_) : nullptr);
+  }
+  return *this;
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>& AVLTree<Key, Value>::operator=(AVLTree<Key, Value>&& other) noexcept
+{
+  if (this != &other)
+  {
+    BinarySearchTree<Key, Value>::operator=(std::move(other));
+    relaxed_ = other.relaxed_;
+    lazy_ = other.lazy_;
+    maxTombstoneRatio_ = other.maxTombstoneRatio_;
+    size_ = other.size_;
+    maxSize_ = other.maxSize_;
+    tombstones_ = other.tombstones_;
+    //clearing the old nodes above freed all of our arenas
+    extras_ = std::move(other.extras_);
+    other.size_ = 0;
+    other.maxSize_ = 0;
+    other.tombstones_ = 0;
+  }
+  return *this;
+}
+
+/**
+* Clears here rather than in ~BinarySearchTree, where destroyHelper would
+* no longer reach our override that frees the nodes in arenas.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::~AVLTree()
+{
+  BinarySearchTree<Key, Value>::clear();
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
@@ -150,185 +490,663 @@ template<class Key, class Value>
 void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
 {
     // TODO
-  if (BinarySearchTree<Key, Value>::root_ == nullptr)
+  AVLNode<Key, Value>* parent;
+  size_t depth;
+  AVLNode<Key, Value>* currNode = findSlot(new_item.first, parent, depth);
+  if (currNode != nullptr)
   {
-    BinarySearchTree<Key, Value>::root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-    //balance will be 0 on the root
+    reviveWith(currNode, new_item.second);
     return;
   }
-  AVLNode<Key, Value>* prevNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_);
-  AVLNode<Key, Value>* currNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_);
-  while (currNode != nullptr)
+  linkNode(makeNode(new_item.first, new_item.second, parent), parent, depth);
+}
+
+/**
+* Links an extracted node back in without allocating. If its key is
+* already in the tree, the existing entry takes the handle's value and
+* the handle's node is freed instead, as with insert(pair).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::insert(NodeHandle&& handle)
+{
+  if (handle.empty())
   {
-    if (currNode->getKey() == new_item.first)
-    {
-      currNode->setValue(new_item.second);
-      return;
-    }
-    else if (currNode->getKey() > new_item.first)
-    {
-      prevNode = currNode;
-      currNode = currNode->getLeft();
-    }
-    else
-    {
-      prevNode = currNode;
-      currNode = currNode->getRight();
-    }
+    return;
   }
-  AVLNode<Key, Value>* temp = new AVLNode<Key, Value>(new_item.first, new_item.second, prevNode);
-  if (prevNode == nullptr)
+  AVLNode<Key, Value>* parent;
+  size_t depth;
+  AVLNode<Key, Value>* currNode = findSlot(handle.key(), parent, depth);
+  if (currNode != nullptr)
   {
-    BinarySearchTree<Key, Value>::root_ = temp;
+    reviveWith(currNode, handle.value());
+    handle = NodeHandle();
     return;
   }
-  if (prevNode->getKey() > new_item.first)
+  AVLNode<Key, Value>* node = handle.node_;
+  handle.node_ = nullptr;
+  linkNode(node, parent, depth);
+}
+
+/*
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the predecessor and then remove.
+ */
+template<class Key, class Value>
+void AVLTree<Key, Value>:: remove(const Key& key)
+{
+    // TODO
+  if (bloomExcludes(key))
   {
-    prevNode->setLeft(temp);
-    currNode = prevNode->getLeft();
+    return;
   }
-  else
+  AVLNode<Key, Value>* currNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
+  if (currNode == nullptr)
   {
-    prevNode->setRight(temp);
-    currNode = prevNode->getRight();
+    return;
   }
-  //new node has been created, pointed to by currNode, prevNode is parent
-  //now balance
+  removeNode(currNode);
+}
 
-  AVLNode<Key, Value>* parent = currNode->getParent();
-  if (parent == nullptr)
-    return;
+/**
+* Removes the entry at pos, which must be a valid iterator into this tree,
+* and returns an iterator to the next entry. Unlike remove(key) there is
+* no search: the node is unlinked and the tree retraced from where it is.
+* Iterators to other entries stay valid, so a scan can erase as it goes.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::iterator AVLTree<Key, Value>::erase(iterator pos)
+{
+  AVLNode<Key, Value>* currNode = static_cast<AVLNode<Key, Value>*>(this->iteratorNode(pos));
+  //nodes are relinked, never moved or freed, so next survives the removal
+  ++pos;
+  removeNode(currNode);
+  return pos;
+}
 
-  if (parent->getLeft() != nullptr && parent->getRight() != nullptr)
+/**
+* Unlinks the entry with the given key and returns it as a node handle,
+* or an empty handle if the key is absent. Even in lazy mode the node is
+* unlinked right away, since the handle takes it.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::NodeHandle AVLTree<Key, Value>::extract(const Key& key)
+{
+  return extract(BinarySearchTree<Key, Value>::find(key));
+}
+
+/**
+* Unlinks the entry at pos, which must be an iterator into this tree, and
+* returns it as a node handle. Other iterators stay valid.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::NodeHandle AVLTree<Key, Value>::extract(iterator pos)
+{
+  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->iteratorNode(pos));
+  if (node == nullptr)
+  {
+    return NodeHandle();
+  }
+  detach(node);
+  if (hasArenas())
+  {
+    //a handle owns a heap node, so one laid out by defragment is copied out
+    AVLNode<Key, Value>* copy = copyNode(*node, nullptr);
+    destroyNode(node);
+    node = copy;
+  }
+  return NodeHandle(node);
+}
+
+/**
+* Moves every entry of other into this tree, leaving other empty; where
+* both hold a key, other's value wins, as with insert. No node is
+* allocated or copied, and this tree keeps its own mode settings.
+*
+* When the smaller tree holds under 1/LINEAR_MERGE_RATIO of the larger's
+* nodes, its nodes are relinked one by one into the larger, in key order,
+* so the search paths of consecutive nodes overlap and stay cached:
+* O(m log(n + m)). Otherwise both trees are flattened, merged and rebuilt
+* into a perfectly balanced tree in O(n + m) (see mergeLinear).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::merge(AVLTree<Key, Value>&& other)
+{
+  if (this == &other || other.root_ == nullptr)
   {
-    parent->setBalance(0);
     return;
   }
-  if (currNode == parent->getLeft())
+  adoptArenas(other);
+  size_t ours = size_ + tombstones_;
+  size_t theirs = other.size_ + other.tombstones_;
+  if (LINEAR_MERGE_RATIO * std::min(ours, theirs) >= std::max(ours, theirs))
   {
-    parent->updateBalance(-1);
+    mergeLinear(other);
+    return;
   }
-  else
+  AVLNode<Key, Value>* smaller = static_cast<AVLNode<Key, Value>*>(other.root_);
+  bool overwrite = true;
+  if (other.size_ + other.tombstones_ > size_ + tombstones_)
   {
-    parent->updateBalance(1);
+    //link our nodes into other's tree instead, keeping other's values
+    smaller = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_);
+    overwrite = false;
+    BinarySearchTree<Key, Value>::root_ = other.root_;
+    size_ = other.size_;
+    maxSize_ = other.maxSize_;
+    tombstones_ = other.tombstones_;
+    if (!relaxed_ && other.relaxed_)
+    {
+      //other's balances may be stale
+      rebalance();
+    }
+    if (hasBloomFilter())
+    {
+      //other's keys never went through our filter
+      rebuildBloom();
+    }
   }
+  other.root_ = nullptr;
+  other.size_ = 0;
+  other.maxSize_ = 0;
+  other.tombstones_ = 0;
 
-  AVLNode<Key, Value>* grandParent = parent->getParent();
-  while (grandParent != nullptr)
+  //in-order walk over an explicit stack, so that a node can be relinked
+  //as soon as it is reached without losing the way through its old tree
+  std::vector<AVLNode<Key, Value>*> stack;
+  AVLNode<Key, Value>* currNode = smaller;
+  while (currNode != nullptr || !stack.empty())
   {
-    if (parent == grandParent->getLeft())
+    while (currNode != nullptr)
     {
-      grandParent->updateBalance(-1);
+      stack.push_back(currNode);
+      currNode = currNode->getLeft();
     }
-    else
+    AVLNode<Key, Value>* node = stack.back();
+    stack.pop_back();
+    currNode = node->getRight();
+    if (node->isTombstone())
     {
-      grandParent->updateBalance(1);
+      destroyNode(node);
+      continue;
     }
-
-    if (grandParent->getBalance() == 0)
-      break;
-    if (rotateP(grandParent, parent))
+    AVLNode<Key, Value>* parent;
+    size_t depth;
+    AVLNode<Key, Value>* existing = findSlot(node->getKey(), parent, depth);
+    if (existing == nullptr)
     {
-      //if we did rotate, then break
-      break;
+      node->setLeft(nullptr);
+      node->setRight(nullptr);
+      node->setBalance(0);
+      linkNode(node, parent, depth);
+      continue;
     }
-
-    currNode = parent;
-    parent = grandParent;
-    grandParent = grandParent->getParent();
+    if (overwrite || existing->isTombstone())
+    {
+      reviveWith(existing, node->getValue());
+    }
+    destroyNode(node);
+  }
+  if (!lazy_ && tombstones_ > 0)
+  {
+    compact();
   }
-
 }
 
-/*
- * Recall: The writeup specifies that if a node has 2 children you
- * should swap with the predecessor and then remove.
- */
+/**
+* Inserts the pairs in [first, last), whose keys must be strictly
+* increasing, overwriting the values of keys already present. The pairs
+* are linked straight into a balanced tree, which is then merged in, so
+* filling an empty tree costs O(m) and a batch of similar size to the
+* tree O(n + m), instead of a descent and rebalance per pair.
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<typename InputIt>
+void AVLTree<Key, Value>::insertSorted(InputIt first, InputIt last)
 {
-    // TODO
-  AVLNode<Key, Value>* currNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
-  if (currNode == nullptr)
-  {
-    return;
-  }
-  AVLNode<Key, Value>* parent = currNode->getParent();
-  //deletion may ruin balance
-  BinarySearchTree<Key, Value>::removeHelp(currNode);
-  currNode = nullptr; // safety
-
-  if (parent == nullptr)
+  std::vector<AVLNode<Key, Value>*> nodes;
+  try
   {
-    if (BinarySearchTree<Key, Value>::root_ == nullptr)
-      return;
-    else
+    for (; first != last; ++first)
     {
-      parent = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_);
-      if (parent->getLeft() != nullptr)
-        rotateP(parent, parent->getLeft());
-      else if (parent->getRight() != nullptr)
-        rotateP(parent, parent->getRight());
-      return;
+      nodes.push_back(makeNode(first->first, first->second, nullptr));
     }
   }
-  AVLNode<Key, Value>* grandParent;
-  if (parent->getLeft() != nullptr)
-  {// if left exists, we deleted the right
-    parent->updateBalance(-1);
-    rotateP(parent, parent->getLeft());
-    //there is still one child, so tree balance above parent is unaffected
-    return;
-  }
-  else if (parent->getRight() != nullptr)
-  {// if right exists, we deleted the left
-    parent->updateBalance(1);
-    rotateP(parent, parent->getRight());
-    return;
+  catch (...)
+  {
+    for (size_t i = 0; i < nodes.size(); i++)
+      delete nodes[i];
+    throw;
   }
-
- //no children, balance is harder
-
-
-  currNode = parent;
-  parent = parent->getParent();
-  if (parent == nullptr)
+  if (nodes.empty())
   {
     return;
   }
-  grandParent = parent->getParent();
+  //built through this tree so that subclasses see every subtreeChanged
+  AVLTree<Key, Value> batch;
+  int height;
+  batch.root_ = buildBalanced(nodes, 0, nodes.size(), nullptr, height);
+  batch.size_ = nodes.size();
+  batch.maxSize_ = nodes.size();
+  merge(std::move(batch));
+}
 
-  while (grandParent != nullptr)
+/**
+* The O(n + m) half of merge: collects both trees' nodes in key order,
+* frees the tombstones and the losing node of each shared key, and links
+* the rest into a perfectly balanced tree with exact balances.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::mergeLinear(AVLTree<Key, Value>& other)
+{
+  std::vector<AVLNode<Key, Value>*> ours;
+  std::vector<AVLNode<Key, Value>*> theirs;
+  collectInOrder(static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_), ours);
+  collectInOrder(static_cast<AVLNode<Key, Value>*>(other.root_), theirs);
+  std::vector<AVLNode<Key, Value>*> nodes;
+  nodes.reserve(size_ + other.size_);
+  size_t i = 0, j = 0;
+  while (i < ours.size() || j < theirs.size())
   {
-    if (parent == grandParent->getLeft())
+    AVLNode<Key, Value>* next;
+    if (j == theirs.size() || (i < ours.size() && ours[i]->getKey() < theirs[j]->getKey()))
     {
-      grandParent->updateBalance(-1);
+      next = ours[i++];
     }
-    else
+    else if (i == ours.size() || theirs[j]->getKey() < ours[i]->getKey())
     {
-      grandParent->updateBalance(1);
+      next = theirs[j++];
     }
-
-    if (rotateP(grandParent, parent))
+    else if (theirs[j]->isTombstone())
     {
-      grandParent = parent->getParent();
+      //other's removal of a key does not remove ours
+      destroyNode(theirs[j++]);
+      next = ours[i++];
     }
     else
     {
-      parent = grandParent;
-      grandParent = grandParent->getParent();
+      destroyNode(ours[i++]);
+      next = theirs[j++];
     }
+    if (next->isTombstone())
+      destroyNode(next);
+    else
+      nodes.push_back(next);
   }
 
+  int height;
+  BinarySearchTree<Key, Value>::root_ = buildBalanced(nodes, 0, nodes.size(), nullptr, height);
+  size_ = nodes.size();
+  maxSize_ = size_;
+  tombstones_ = 0;
+  other.root_ = nullptr;
+  other.size_ = 0;
+  other.maxSize_ = 0;
+  other.tombstones_ = 0;
+  if (hasBloomFilter())
+  {
+    rebuildBloom();
+  }
 }
 
-
+/**
+* Appends the nodes under subRoot, tombstones included, to out in key
+* order. Following successor links pays one cache miss after another, so
+* the tree is instead cut into up to FIND_BATCH_WIDTH subtrees a few
+* levels down, which are walked together, one step each per round, as
+* findBatch does with lookups. Each walk prefetches the node it moves to.
+*/
 template<class Key, class Value>
-bool AVLTree<Key, Value>::rotateP(AVLNode<Key, Value>* p, AVLNode<Key, Value>* c)
+void AVLTree<Key, Value>::collectInOrder(AVLNode<Key, Value>* subRoot, std::vector<AVLNode<Key, Value>*>& out)
 {
-  if (p == nullptr || c == nullptr)
-    return false;
-  if (p->getBalance() > 1)
+  struct Walk
+  {
+    std::vector<AVLNode<Key, Value>*> stack;
+    AVLNode<Key, Value>* currNode;
+    std::vector<AVLNode<Key, Value>*> nodes;
+  };
+
+  //the nodes above the cut, and the subtrees below it, in key order
+  std::vector<std::pair<AVLNode<Key, Value>*, bool> > parts;
+  size_t levels = 0;
+  while ((static_cast<size_t>(1) << levels) < BinarySearchTree<Key, Value>::FIND_BATCH_WIDTH)
+    levels++;
+  cutForWalk(subRoot, levels, parts);
+
+  std::vector<Walk> walks;
+  std::vector<size_t> active;
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    if (parts[i].second)
+    {
+      active.push_back(walks.size());
+      walks.push_back(Walk());
+      walks.back().currNode = parts[i].first;
+    }
+  }
+  while (!active.empty())
+  {
+    for (size_t i = 0; i < active.size(); )
+    {
+      Walk& walk = walks[active[i]];
+      if (walk.currNode != nullptr)
+      {
+        walk.stack.push_back(walk.currNode);
+        walk.currNode = walk.currNode->getLeft();
+      }
+      else
+      {
+        AVLNode<Key, Value>* node = walk.stack.back();
+        walk.stack.pop_back();
+        walk.nodes.push_back(node);
+        walk.currNode = node->getRight();
+      }
+      if (walk.currNode != nullptr)
+      {
+#if defined(__GNUC__)
+        __builtin_prefetch(walk.currNode);
+#endif
+        i++;
+      }
+      else if (!walk.stack.empty())
+      {
+        i++;
+      }
+      else
+      {
+        active[i] = active.back();
+        active.pop_back();
+      }
+    }
+  }
+
+  size_t nextWalk = 0;
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    if (parts[i].second)
+    {
+      std::vector<AVLNode<Key, Value>*>& nodes = walks[nextWalk++].nodes;
+      out.insert(out.end(), nodes.begin(), nodes.end());
+    }
+    else
+    {
+      out.push_back(parts[i].first);
+    }
+  }
+}
+
+/**
+* Lists, in key order, the nodes of the top levels of the subtree at
+* currNode as (node, false) and the subtrees hanging below them as
+* (root, true).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::cutForWalk(AVLNode<Key, Value>* currNode, size_t levels,
+    std::vector<std::pair<AVLNode<Key, Value>*, bool> >& parts)
+{
+  if (currNode == nullptr)
+    return;
+  if (levels == 0)
+  {
+    parts.push_back(std::make_pair(currNode, true));
+    return;
+  }
+  cutForWalk(currNode->getLeft(), levels - 1, parts);
+  parts.push_back(std::make_pair(currNode, false));
+  cutForWalk(currNode->getRight(), levels - 1, parts);
+}
+
+/**
+* Walks down to key. Returns its node if present (tombstone or not);
+* otherwise returns nullptr and sets parent to the node to link a new
+* node under, nullptr for an empty tree, and depth to the new node's depth.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::findSlot(const Key& key, AVLNode<Key, Value>*& parent, size_t& depth) const
+{
+  parent = nullptr;
+  depth = 0;
+  AVLNode<Key, Value>* currNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_);
+  while (currNode != nullptr)
+  {
+    if (currNode->getKey() == key)
+    {
+      return currNode;
+    }
+    parent = currNode;
+    if (currNode->getKey() > key)
+    {
+      currNode = currNode->getLeft();
+    }
+    else
+    {
+      currNode = currNode->getRight();
+    }
+    depth++;
+  }
+  return nullptr;
+}
+
+/**
+* Overwrites an existing node's value, reviving it if it is a tombstone.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::reviveWith(AVLNode<Key, Value>* node, const Value& value)
+{
+  if (node->isTombstone())
+  {
+    //revive the removed entry in place
+    node->setTombstone(false);
+    tombstones_--;
+    size_++;
+    bloomAdd(node->getKey());
+  }
+  node->setValue(value);
+  subtreeChanged(node);
+}
+
+/**
+* Links a detached node in as a leaf under parent (as the root if parent
+* is nullptr), at the given depth, and rebalances.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::linkNode(AVLNode<Key, Value>* currNode, AVLNode<Key, Value>* parent, size_t depth)
+{
+  currNode->setParent(parent);
+  size_++;
+  bloomAdd(currNode->getKey());
+  if (parent == nullptr)
+  {
+    //balance will be 0 on the root
+    BinarySearchTree<Key, Value>::root_ = currNode;
+  }
+  else if (parent->getKey() > currNode->getKey())
+  {
+    parent->setLeft(currNode);
+  }
+  else
+  {
+    parent->setRight(currNode);
+  }
+  subtreeChanged(currNode);
+  if (relaxed_)
+  {
+    relaxedInserted(currNode, depth);
+    return;
+  }
+  //now balance
+
+  if (parent == nullptr)
+    return;
+
+  if (parent->getLeft() != nullptr && parent->getRight() != nullptr)
+  {
+    parent->setBalance(0);
+    return;
+  }
+  if (currNode == parent->getLeft())
+  {
+    parent->updateBalance(-1);
+  }
+  else
+  {
+    parent->updateBalance(1);
+  }
+
+  AVLNode<Key, Value>* grandParent = parent->getParent();
+  while (grandParent != nullptr)
+  {
+    if (parent == grandParent->getLeft())
+    {
+      grandParent->updateBalance(-1);
+    }
+    else
+    {
+      grandParent->updateBalance(1);
+    }
+
+    if (grandParent->getBalance() == 0)
+      break;
+    if (rotateP(grandParent, parent))
+    {
+      //if we did rotate, then break
+      break;
+    }
+
+    currNode = parent;
+    parent = grandParent;
+    grandParent = grandParent->getParent();
+  }
+
+}
+
+/**
+* Removes a live node: marks it as a tombstone in lazy mode, otherwise
+* unlinks and frees it.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::removeNode(AVLNode<Key, Value>* currNode)
+{
+  if (lazy_)
+  {
+    size_--;
+    currNode->setTombstone(true);
+    subtreeChanged(currNode);
+    tombstones_++;
+    bloomRemoved();
+    if (tombstones_ > maxTombstoneRatio_ * (size_ + tombstones_))
+    {
+      compact();
+    }
+    return;
+  }
+  detach(currNode);
+  destroyNode(currNode);
+}
+
+/**
+* Unlinks a live node from the tree and rebalances, without freeing it.
+* The node comes back with no links and a balance of 0.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::detach(AVLNode<Key, Value>* currNode)
+{
+  size_--;
+  //with two children, currNode first trades places with its predecessor
+  AVLNode<Key, Value>* pred = nullptr;
+  if (currNode->getLeft() != nullptr && currNode->getRight() != nullptr)
+  {
+    pred = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(currNode));
+  }
+  if (relaxed_)
+  {
+    //plain unlink; a tree that shrank to half its peak is rebuilt
+    AVLNode<Key, Value>* changed = currNode->getParent();
+    if (pred != nullptr)
+    {
+      changed = (pred->getParent() == currNode) ? pred : pred->getParent();
+    }
+    BinarySearchTree<Key, Value>::unlinkNode(currNode);
+    if (changed != nullptr)
+    {
+      subtreeChanged(changed);
+    }
+    if (pred != nullptr)
+    {
+      subtreeChanged(pred);
+    }
+    if (2 * size_ < maxSize_)
+    {
+      rebalance();
+    }
+  }
+  else
+  {
+    if (pred != nullptr)
+    {
+      //swap positions (and balances) with the predecessor so at most one child remains
+      nodeSwap(currNode, pred);
+    }
+    AVLNode<Key, Value>* parent = currNode->getParent();
+    int8_t diff = 0;
+    if (parent != nullptr)
+    {
+      diff = (parent->getLeft() == currNode) ? 1 : -1;
+    }
+    BinarySearchTree<Key, Value>::unlinkNode(currNode);
+    if (parent != nullptr)
+    {
+      subtreeChanged(parent);
+    }
+    if (pred != nullptr)
+    {
+      subtreeChanged(pred);
+    }
+
+    //retrace: parent's subtree on the side of diff lost one level of height
+    while (parent != nullptr)
+    {
+      AVLNode<Key, Value>* grandParent = parent->getParent();
+      int8_t nextDiff = 0;
+      if (grandParent != nullptr)
+      {
+        nextDiff = (grandParent->getLeft() == parent) ? 1 : -1;
+      }
+
+      parent->updateBalance(diff);
+      if (parent->getBalance() == 1 || parent->getBalance() == -1)
+      {
+        //height of parent's subtree is unchanged
+        break;
+      }
+      if (parent->getBalance() != 0)
+      {
+        AVLNode<Key, Value>* child = (parent->getBalance() > 0) ? parent->getRight() : parent->getLeft();
+        int8_t childBalance = child->getBalance();
+        rotateP(parent, child);
+        if (childBalance == 0)
+        {
+          //single rotation around an even child keeps the height
+          break;
+        }
+      }
+      parent = grandParent;
+      diff = nextDiff;
+    }
+  }
+  currNode->setParent(nullptr);
+  currNode->setLeft(nullptr);
+  currNode->setRight(nullptr);
+  currNode->setBalance(0);
+  bloomRemoved();
+}
+
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::rotateP(AVLNode<Key, Value>* p, AVLNode<Key, Value>* c)
+{
+  if (p == nullptr || c == nullptr)
+    return false;
+  if (p->getBalance() > 1)
   {
     if (c->getBalance() < 0)
     {
@@ -349,14 +1167,15 @@ bool AVLTree<Key, Value>::rotateP(AVLNode<Key, Value>* p, AVLNode<Key, Value>* c
         c->setBalance(0);
       }
       grandC->setBalance(0);
-      rotateRight(c);
-      rotateLeft(p);
+      this->rotateRight(c);
+      this->rotateLeft(p);
     }
     else
     {
-      p->setBalance(0);
-      c->setBalance(0);
-      rotateLeft(p);
+      //c can only be even after a removal, then the height is kept
+      p->setBalance(c->getBalance() == 0 ? 1 : 0);
+      c->setBalance(c->getBalance() == 0 ? -1 : 0);
+      this->rotateLeft(p);
     }
   }
   else if (p->getBalance() < -1)
@@ -380,67 +1199,623 @@ bool AVLTree<Key, Value>::rotateP(AVLNode<Key, Value>* p, AVLNode<Key, Value>* c
         c->setBalance(0);
       }
       grandC->setBalance(0);
-      rotateLeft(c);
-      rotateRight(p);
+      this->rotateLeft(c);
+      this->rotateRight(p);
     }
     else
     {
-      p->setBalance(0);
-      c->setBalance(0);
-      rotateRight(p);
+      p->setBalance(c->getBalance() == 0 ? -1 : 0);
+      c->setBalance(c->getBalance() == 0 ? 1 : 0);
+      this->rotateRight(p);
     }
   }
   else
     return false;
+  subtreeChanged(p);
+  subtreeChanged(c);
   return true;
 }
 
+/**
+* Removes every entry and tombstone.
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* head)
+void AVLTree<Key, Value>::clear()
 {
-  AVLNode<Key, Value>* left = head;
-  AVLNode<Key, Value>* top = head->getRight();
+  BinarySearchTree<Key, Value>::clear();
+  size_ = 0;
+  maxSize_ = 0;
+  tombstones_ = 0;
+  if (hasBloomFilter())
+  {
+    rebuildBloom();
+  }
+}
 
-  left->setRight(top->getLeft());
-  if (left->getRight() != nullptr)
-    left->getRight()->setParent(left);
-  top->setParent(left->getParent());
-  if (top->getParent() != nullptr)
+/**
+* Unlike BinarySearchTree::empty, also true when only tombstones remain.
+*/
+template<class Key, class Value>
+bool AVLTree<Key, Value>::empty() const
+{
+  return size_ == 0;
+}
+
+/**
+* Returns the number of (live) entries.
+*/
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::size() const
+{
+  return size_;
+}
+
+/**
+* Enters or leaves relaxed mode. Leaving it rebalances the whole tree.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::setRelaxed(bool relaxed)
+{
+  if (relaxed == relaxed_)
+    return;
+  if (relaxed)
   {
-    if (top->getParent()->getLeft() == left)
-      top->getParent()->setLeft(top);
-    else
-      top->getParent()->setRight(top);
+    maxSize_ = size_ + tombstones_;
+    relaxed_ = true;
   }
   else
-    BinarySearchTree<Key, Value>::root_ = top;
-  top->setLeft(left);
-  left->setParent(top);
+  {
+    rebalance();
+    relaxed_ = false;
+  }
 }
 
 template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* head)
+bool AVLTree<Key, Value>::isRelaxed() const
 {
-  AVLNode<Key, Value>* right = head;
-  AVLNode<Key, Value>* top = head->getLeft();
+  return relaxed_;
+}
+
+/**
+* Rebuilds the tree into a perfectly balanced shape with exact balances,
+* relinking the existing nodes in O(n).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::rebalance()
+{
+  BinarySearchTree<Key, Value>::root_ = rebuild(static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_));
+  maxSize_ = size_;
+}
+
+/**
+* Enables or disables lazy removal. Disabling it compacts away any
+* remaining tombstones.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::setLazyRemove(bool lazy, double maxTombstoneRatio)
+{
+  lazy_ = lazy;
+  maxTombstoneRatio_ = maxTombstoneRatio;
+  if (!lazy_ && tombstones_ > 0)
+  {
+    compact();
+  }
+}
 
-  right->setLeft(top->getRight());
-  if (right->getLeft() != nullptr)
-    right->getLeft()->setParent(right);
-  top->setParent(right->getParent());
-  if (top->getParent() != nullptr)
+template<class Key, class Value>
+bool AVLTree<Key, Value>::isLazyRemove() const
+{
+  return lazy_;
+}
+
+/**
+* Returns the number of tombstones still linked into the tree.
+*/
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::tombstoneCount() const
+{
+  return tombstones_;
+}
+
+/**
+* Enables or disables the bloom filter in front of find, operator[] and
+* remove. Enabling it, or changing the false-positive rate, builds the
+* filter from the live keys in O(n).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::setBloomFilter(bool enabled, double falsePositiveRate)
+{
+  if (!enabled)
   {
-    if (top->getParent()->getLeft() == right)
-      top->getParent()->setLeft(top);
+    if (extras_ != nullptr)
+    {
+      extras_->bloom = BloomFilter();
+      extras_->bloomHash = nullptr;
+      extras_->bloomCapacity = 0;
+      extras_->bloomRemoved = 0;
+    }
+    return;
+  }
+  //the hash is bound here, so that trees that never use a filter do not
+  //need std::hash for their keys
+  extras().bloomHash = &BloomFilter::hashOf<Key>;
+  extras_->bloomFalsePositiveRate = falsePositiveRate;
+  rebuildBloom();
+}
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::hasBloomFilter() const
+{
+  return extras_ != nullptr && extras_->bloomHash != nullptr;
+}
+
+/**
+* Returns how many find, operator[] and remove calls the bloom filter
+* answered without descending the tree.
+*/
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::bloomSkips() const
+{
+  return extras_ == nullptr ? 0 : extras_->bloomSkips.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::bloomBytes() const
+{
+  return extras_ == nullptr ? 0 : extras_->bloom.bytes();
+}
+
+/**
+* As BinarySearchTree::find, but a key the bloom filter rules out returns
+* end() without a descent.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::iterator AVLTree<Key, Value>::find(const Key& key) const
+{
+  if (bloomExcludes(key))
+  {
+    return BinarySearchTree<Key, Value>::end();
+  }
+  return BinarySearchTree<Key, Value>::find(key);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& AVLTree<Key, Value>::operator[](const Key& key)
+{
+  if (bloomExcludes(key)) throw std::out_of_range("Invalid key");
+  return BinarySearchTree<Key, Value>::operator[](key);
+}
+
+template<class Key, class Value>
+Value const & AVLTree<Key, Value>::operator[](const Key& key) const
+{
+  if (bloomExcludes(key)) throw std::out_of_range("Invalid key");
+  return BinarySearchTree<Key, Value>::operator[](key);
+}
+
+/**
+* Frees every tombstone and relinks the live nodes into a perfectly
+* balanced tree, in one O(n) pass.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::compact()
+{
+  std::vector<AVLNode<Key, Value>*> nodes;
+  std::vector<AVLNode<Key, Value>*> live;
+  nodes.reserve(size_ + tombstones_);
+  live.reserve(size_);
+  for (Node<Key, Value>* currNode = this->getSmallestNode(); currNode != nullptr; currNode = this->successor(currNode))
+  {
+    nodes.push_back(static_cast<AVLNode<Key, Value>*>(currNode));
+  }
+  //free only after the walk, which still follows the tombstones' links
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    if (nodes[i]->isTombstone())
+      destroyNode(nodes[i]);
     else
-      top->getParent()->setRight(top);
+      live.push_back(nodes[i]);
+  }
+  int height;
+  BinarySearchTree<Key, Value>::root_ = buildBalanced(live, 0, live.size(), nullptr, height);
+  tombstones_ = 0;
+  maxSize_ = size_;
+}
+
+/**
+* Moves every node into one new arena, in key order (see below).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::defragment()
+{
+  iterator it = BinarySearchTree<Key, Value>::begin();
+  while (it != BinarySearchTree<Key, Value>::end())
+  {
+    it = defragment(it, size_ + tombstones_);
+  }
+}
+
+/**
+* Moves the nodes of up to maxNodes entries, starting at first, into a
+* new arena owned by the tree, without changing the tree's shape or
+* balances, and returns an iterator to the first entry not moved (end()
+* when done). The nodes are laid out back to back in key order, so an
+* in-order scan reads the arena sequentially (see meanSuccessorDistance).
+* Keys and values are copied. Iterators into the moved range are
+* invalidated.
+*
+* Calling this in a loop with a small maxNodes spreads the work over
+* time, with one arena per step. Nodes inserted later are allocated on
+* their own as usual; an arena's memory is freed once all of its nodes
+* are gone.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::iterator AVLTree<Key, Value>::defragment(iterator first, size_t maxNodes)
+{
+  std::vector<AVLNode<Key, Value>*> nodes;
+  Node<Key, Value>* currNode = this->iteratorNode(first);
+  if (first == BinarySearchTree<Key, Value>::begin())
+  {
+    //tombstones before the first entry have no entry to ride along with,
+    //so they join the first step without counting against maxNodes
+    for (Node<Key, Value>* node = this->getSmallestNode(); node != currNode; node = this->successor(node))
+    {
+      nodes.push_back(static_cast<AVLNode<Key, Value>*>(node));
+    }
   }
+  size_t leading = nodes.size();
+  //tombstones ride along with the entry before them
+  while (currNode != nullptr && (nodes.size() - leading < maxNodes || currNode->isTombstone()))
+  {
+    nodes.push_back(static_cast<AVLNode<Key, Value>*>(currNode));
+    currNode = this->successor(currNode);
+  }
+  if (!nodes.empty())
+  {
+    char* arena = newArena(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+      relocate(nodes[i], arena + i * nodeSize());
+    }
+  }
+  return this->iteratorAt(currNode);
+}
+
+/**
+* Constructs a copy of node in block, puts it in node's place and
+* destroys node.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::relocate(AVLNode<Key, Value>* node, void* block)
+{
+  AVLNode<Key, Value>* parent = node->getParent();
+  AVLNode<Key, Value>* copy = copyNode(*node, block);
+  copy->setParent(parent);
+  copy->setLeft(node->getLeft());
+  copy->setRight(node->getRight());
+  if (copy->getLeft() != nullptr)
+    copy->getLeft()->setParent(copy);
+  if (copy->getRight() != nullptr)
+    copy->getRight()->setParent(copy);
+  if (parent == nullptr)
+    BinarySearchTree<Key, Value>::root_ = copy;
+  else if (parent->getLeft() == node)
+    parent->setLeft(copy);
   else
-    BinarySearchTree<Key, Value>::root_ = top;
-  top->setRight(right);
-  right->setParent(top);
+    parent->setRight(copy);
+  destroyNode(node);
+}
+
+/**
+* Allocates an arena for capacity nodes, all counted as live since
+* defragment fills it at once, and returns its memory.
+*/
+template<class Key, class Value>
+char* AVLTree<Key, Value>::newArena(size_t capacity)
+{
+  NodeArena arena;
+  arena.begin = static_cast<char*>(::operator new(capacity * nodeSize()));
+  arena.end = arena.begin + capacity * nodeSize();
+  arena.live = capacity;
+  std::vector<NodeArena>& arenas = extras().arenas;
+  arenas.insert(std::upper_bound(arenas.begin(), arenas.end(), arena.begin, addressBefore), arena);
+  return arena.begin;
+}
+
+/**
+* Takes over other's arenas along with its nodes, as merge does.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::adoptArenas(AVLTree<Key, Value>& other)
+{
+  if (!other.hasArenas())
+  {
+    return;
+  }
+  std::vector<NodeArena>& arenas = extras().arenas;
+  for (size_t i = 0; i < other.extras_->arenas.size(); i++)
+  {
+    const NodeArena& arena = other.extras_->arenas[i];
+    arenas.insert(std::upper_bound(arenas.begin(), arenas.end(), arena.begin, addressBefore), arena);
+  }
+  other.extras_->arenas.clear();
+}
+
+/**
+* Frees a node that is no longer linked in: deletes it, or, if defragment
+* put it in an arena, destroys it there and frees the arena once empty.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::destroyNode(AVLNode<Key, Value>* node)
+{
+  if (hasArenas())
+  {
+    //the last arena starting at or below the node is the only candidate
+    std::vector<NodeArena>& arenas = extras_->arenas;
+    char* address = reinterpret_cast<char*>(node);
+    typename std::vector<NodeArena>::iterator arena =
+        std::upper_bound(arenas.begin(), arenas.end(), address, addressBefore);
+    if (arena != arenas.begin())
+    {
+      --arena;
+      if (std::less<char*>()(address, arena->end))
+      {
+        node->~AVLNode<Key, Value>();
+        if (--arena->live == 0)
+        {
+          ::operator delete(arena->begin);
+          arenas.erase(arena);
+        }
+        return;
+      }
+    }
+  }
+  delete node;
+}
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::addressBefore(char* address, const NodeArena& arena)
+{
+  return std::less<char*>()(address, arena.begin);
+}
+
+/**
+* As BinarySearchTree::destroyHelper, but frees nodes through destroyNode.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::destroyHelper(Node<Key, Value>* currNode)
+{
+  if (currNode == nullptr)
+    return;
+  destroyHelper(currNode->getLeft());
+  destroyHelper(currNode->getRight());
+  destroyNode(static_cast<AVLNode<Key, Value>*>(currNode));
+}
+
+/**
+* Called in relaxed mode after node was linked in at the given depth
+* (root = 0). If that exceeds the height bound, walks up to the first
+* ancestor whose larger child holds over 3/4 of its subtree and rebuilds
+* that subtree; one exists since 3 log2 n exceeds log_{4/3} n.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::relaxedInserted(AVLNode<Key, Value>* node, size_t depth)
+{
+  maxSize_ = std::max(maxSize_, size_);
+
+  size_t bound = 3;
+  for (size_t n = size_ + tombstones_; n > 1; n /= 2)
+    bound += 3;
+  if (depth <= bound)
+    return;
+
+  size_t childSize = 1;
+  AVLNode<Key, Value>* child = node;
+  AVLNode<Key, Value>* parent = node->getParent();
+  while (parent != nullptr)
+  {
+    Node<Key, Value>* sibling = (parent->getLeft() == child) ? parent->getRight() : parent->getLeft();
+    size_t parentSize = 1 + childSize + subtreeSize(sibling);
+    if (4 * childSize > 3 * parentSize)
+    {
+      AVLNode<Key, Value>* grandParent = parent->getParent();
+      bool wasLeft = (grandParent != nullptr && grandParent->getLeft() == parent);
+      AVLNode<Key, Value>* newTop = rebuild(parent);
+      if (grandParent == nullptr)
+        BinarySearchTree<Key, Value>::root_ = newTop;
+      else if (wasLeft)
+        grandParent->setLeft(newTop);
+      else
+        grandParent->setRight(newTop);
+      return;
+    }
+    childSize = parentSize;
+    child = parent;
+    parent = parent->getParent();
+  }
+}
+
+/**
+* Relinks the subtree at subRoot into a perfectly balanced subtree with
+* exact balance factors and returns its new top, whose parent is subRoot's
+* old parent. The caller re-points that parent's child link.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::rebuild(AVLNode<Key, Value>* subRoot)
+{
+  if (subRoot == nullptr)
+    return nullptr;
+  AVLNode<Key, Value>* parent = subRoot->getParent();
+  std::vector<AVLNode<Key, Value>*> nodes;
+  //in-order walk confined to the subtree
+  AVLNode<Key, Value>* currNode = subRoot;
+  while (currNode->getLeft() != nullptr)
+    currNode = currNode->getLeft();
+  while (currNode != nullptr)
+  {
+    nodes.push_back(currNode);
+    if (currNode->getRight() != nullptr)
+    {
+      currNode = currNode->getRight();
+      while (currNode->getLeft() != nullptr)
+        currNode = currNode->getLeft();
+    }
+    else
+    {
+      while (currNode != subRoot && currNode->getParent()->getRight() == currNode)
+        currNode = currNode->getParent();
+      currNode = (currNode == subRoot) ? nullptr : currNode->getParent();
+    }
+  }
+  int height;
+  return buildBalanced(nodes, 0, nodes.size(), parent, height);
+}
+
+/**
+* Links nodes[lo, hi) into a balanced subtree under parent, storing its
+* height in height and returning its root.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::buildBalanced(std::vector<AVLNode<Key, Value>*>& nodes,
+    size_t lo, size_t hi, AVLNode<Key, Value>* parent, int& height)
+{
+  if (lo >= hi)
+  {
+    height = 0;
+    return nullptr;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  AVLNode<Key, Value>* top = nodes[mid];
+  int leftHeight, rightHeight;
+  top->setParent(parent);
+  top->setLeft(buildBalanced(nodes, lo, mid, top, leftHeight));
+  top->setRight(buildBalanced(nodes, mid + 1, hi, top, rightHeight));
+  top->setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+  height = std::max(leftHeight, rightHeight) + 1;
+  subtreeChanged(top);
+  return top;
 }
 
+/**
+* Counts the nodes in a subtree.
+*/
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::subtreeSize(Node<Key, Value>* currNode)
+{
+  if (currNode == nullptr)
+    return 0;
+  return 1 + subtreeSize(currNode->getLeft()) + subtreeSize(currNode->getRight());
+}
+
+/**
+* True if there is a bloom filter and it rules key out, which is then
+* counted as a skipped descent.
+*/
+template<class Key, class Value>
+bool AVLTree<Key, Value>::bloomExcludes(const Key& key) const
+{
+  if (!hasBloomFilter() || extras_->bloom.mayContain(extras_->bloomHash(key)))
+  {
+    return false;
+  }
+  extras_->bloomSkips.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+/**
+* Adds a newly live key to the bloom filter, if there is one. Once the
+* filter holds more keys than it was sized for, its false-positive rate
+* would climb, so it is rebuilt at twice the size.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::bloomAdd(const Key& key)
+{
+  if (!hasBloomFilter())
+    return;
+  Extras& state = *extras_;
+  if (state.bloom.count() >= state.bloomCapacity)
+  {
+    rebuildBloom();
+    if (state.bloom.mayContain(state.bloomHash(key)))
+      return;
+  }
+  state.bloom.add(state.bloomHash(key));
+}
+
+/**
+* Records that a key stopped being live. Its bits stay set, so once such
+* keys reach a quarter of those added the filter is rebuilt.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::bloomRemoved()
+{
+  if (!hasBloomFilter())
+    return;
+  extras_->bloomRemoved++;
+  if (4 * extras_->bloomRemoved > extras_->bloom.count())
+  {
+    rebuildBloom();
+  }
+}
+
+/**
+* Sizes the bloom filter for twice the live keys and adds them all.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::rebuildBloom()
+{
+  Extras& state = *extras_;
+  state.bloomCapacity = std::max(2 * size_, static_cast<size_t>(MIN_BLOOM_CAPACITY));
+  state.bloom.reset(state.bloomCapacity, state.bloomFalsePositiveRate);
+  for (Node<Key, Value>* currNode = this->getSmallestNode(); currNode != nullptr; currNode = this->successor(currNode))
+  {
+    if (!currNode->isTombstone())
+      state.bloom.add(state.bloomHash(currNode->getKey()));
+  }
+  state.bloomRemoved = 0;
+}
+
+/**
+* The out-of-line state, allocated here the first time it is needed.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::Extras& AVLTree<Key, Value>::extras()
+{
+  if (extras_ == nullptr)
+  {
+    extras_.reset(new Extras());
+  }
+  return *extras_;
+}
+
+template<class Key, class Value>
+bool AVLTree<Key, Value>::hasArenas() const
+{
+  return extras_ != nullptr && !extras_->arenas.empty();
+}
+
+template<class Key, class Value>
+AVLTree<Key, Value>::Extras::Extras() :
+    bloomHash(nullptr), bloomFalsePositiveRate(0.01), bloomCapacity(0), bloomRemoved(0), bloomSkips(0)
+{
+
+}
+
+/**
+* The arenas belong to the nodes of the tree copied from, so the copy
+* starts without any, and with its own count of skips.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::Extras::Extras(const Extras& other) :
+    bloom(other.bloom), bloomHash(other.bloomHash), bloomFalsePositiveRate(other.bloomFalsePositiveRate),
+    bloomCapacity(other.bloomCapacity), bloomRemoved(other.bloomRemoved), bloomSkips(0)
+{
+
+}
 
 //may be calling the wrong version of node swap in removehelp
 
@@ -453,5 +1828,54 @@ void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>*
     n2->setBalance(tempB);
 }
 
+/**
+* Called after the entries under node, or their arrangement, changed:
+* node was linked in, had its value or tombstone changed, was rotated,
+* rebuilt, took the place of a removed node, or had a descendant
+* unlinked. Every such node is reported once the links are final, so a
+* derived tree can keep per-subtree state (see MerkleAVLTree) by
+* invalidating node and its ancestors. Does nothing here.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::subtreeChanged(AVLNode<Key, Value>*)
+{
+
+}
+
+/**
+* Allocates a new unlinked node. Every node the tree creates for an entry
+* comes from here, so a derived tree with its own node type (see
+* MerkleAVLTree) overrides this, copyNode and nodeSize together.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) const
+{
+  return new AVLNode<Key, Value>(key, value, parent);
+}
+
+/**
+* Constructs an unlinked copy of node, with its balance and tombstone, in
+* block, which holds nodeSize() bytes, or on the heap if block is nullptr.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::copyNode(const AVLNode<Key, Value>& node, void* block) const
+{
+  AVLNode<Key, Value>* copy = (block == nullptr)
+      ? new AVLNode<Key, Value>(node.getKey(), node.getValue(), nullptr)
+      : new (block) AVLNode<Key, Value>(node.getKey(), node.getValue(), nullptr);
+  copy->setBalance(node.getBalance());
+  copy->setTombstone(node.isTombstone());
+  return copy;
+}
+
+/**
+* The size of the nodes makeNode creates, for laying them out in arenas.
+*/
+template<class Key, class Value>
+size_t AVLTree<Key, Value>::nodeSize() const
+{
+  return sizeof(AVLNode<Key, Value>);
+}
+
 
 #endif
@@ -0,0 +1,202 @@
+#ifndef AVLSET_H
+#define AVLSET_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* The Value type of a set. It is empty and is never stored in a node.
+*/
+struct NoValue { };
+
+inline std::ostream& operator<<(std::ostream& out, const NoValue&)
+{
+    return out << "-";
+}
+
+/**
+* The item of a key-only node. It exposes the same first/second members as
+* a key/value pair so the tree code (and printRoot) work unchanged, but
+* second is a shared static, leaving just the key in each node.
+*/
+template <typename Key>
+struct SetItem
+{
+    SetItem(const Key& key, const NoValue&) : first(key) { }
+
+    const Key first;
+    static NoValue second;
+};
+
+template <typename Key>
+NoValue SetItem<Key>::second;
+
+template <typename Key>
+struct NodeItem<Key, NoValue>
+{
+    typedef SetItem<Key> type;
+};
+
+/**
+* An ordered set built on AVLTree<Key, NoValue>. Nodes hold only the key,
+* links and balance.
+*/
+template <typename Key>
+class AVLSet : protected AVLTree<Key, NoValue>
+{
+public:
+    void insert(const Key& key);
+    bool contains(const Key& key) const;
+    void erase(const Key& key);
+    using AVLTree<Key, NoValue>::clear;
+    using AVLTree<Key, NoValue>::empty;
+    using AVLTree<Key, NoValue>::isBalanced;
+    using AVLTree<Key, NoValue>::print;
+
+    /**
+    * An iterator over the keys, in order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const Key& operator*() const;
+        const Key* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class AVLSet<Key>;
+        iterator(typename AVLTree<Key, NoValue>::iterator it);
+        typename AVLTree<Key, NoValue>::iterator it_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the AVLSet::iterator class.
+  ----------------------------------------------------
+*/
+
+/**
+* Explicit constructor wrapping a tree iterator.
+*/
+template<typename Key>
+AVLSet<Key>::iterator::iterator(typename AVLTree<Key, NoValue>::iterator it) :
+    it_(it)
+{
+
+}
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<typename Key>
+AVLSet<Key>::iterator::iterator()
+{
+
+}
+
+template<typename Key>
+const Key& AVLSet<Key>::iterator::operator*() const
+{
+  return it_->first;
+}
+
+template<typename Key>
+const Key* AVLSet<Key>::iterator::operator->() const
+{
+  return &(it_->first);
+}
+
+template<typename Key>
+bool AVLSet<Key>::iterator::operator==(const iterator& rhs) const
+{
+  return it_ == rhs.it_;
+}
+
+template<typename Key>
+bool AVLSet<Key>::iterator::operator!=(const iterator& rhs) const
+{
+  return !(*this == rhs);
+}
+
+template<typename Key>
+typename AVLSet<Key>::iterator& AVLSet<Key>::iterator::operator++()
+{
+  ++it_;
+  return *this;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the AVLSet::iterator class.
+  --------------------------------------------------
+*/
+
+/*
+  -------------------------------------------
+  Begin implementations for the AVLSet class.
+  -------------------------------------------
+*/
+
+/**
+* Adds key to the set. Inserting an existing key does nothing.
+*/
+template<typename Key>
+void AVLSet<Key>::insert(const Key& key)
+{
+  AVLTree<Key, NoValue>::insert(std::make_pair(key, NoValue()));
+}
+
+template<typename Key>
+bool AVLSet<Key>::contains(const Key& key) const
+{
+  return this->internalFind(key) != nullptr;
+}
+
+/**
+* Removes key from the set, if present.
+*/
+template<typename Key>
+void AVLSet<Key>::erase(const Key& key)
+{
+  AVLTree<Key, NoValue>::remove(key);
+}
+
+template<typename Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::begin() const
+{
+  return iterator(AVLTree<Key, NoValue>::begin());
+}
+
+template<typename Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::end() const
+{
+  return iterator(AVLTree<Key, NoValue>::end());
+}
+
+template<typename Key>
+typename AVLSet<Key>::iterator AVLSet<Key>::find(const Key& key) const
+{
+  return iterator(AVLTree<Key, NoValue>::find(key));
+}
+
+/*
+  -----------------------------------------
+  End implementations for the AVLSet class.
+  -----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+/**
+* A blocked bloom filter: each key sets and tests all of its bits within
+* one 64-byte block, so a query costs one cache miss however many hash
+* functions the false-positive rate calls for. Keys go in as 64-bit
+* hashes; hashOf() makes one from any key std::hash accepts.
+*/
+class BloomFilter
+{
+public:
+    BloomFilter();
+    BloomFilter(size_t expectedKeys, double falsePositiveRate);
+
+    void reset(size_t expectedKeys, double falsePositiveRate);
+    void clear();
+    void add(uint64_t hash);
+    bool mayContain(uint64_t hash) const;
+    size_t count() const;
+    size_t bytes() const;
+
+    template <typename Key>
+    static uint64_t hashOf(const Key& key);
+
+protected:
+    static const size_t WORDS_PER_BLOCK = 8;
+
+    static uint64_t mix(uint64_t hash);
+    const uint64_t* block(uint64_t hash) const;
+
+    std::vector<uint64_t> words_;
+    size_t blockCount_;
+    unsigned probes_;
+    size_t count_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the BloomFilter class.
+  ------------------------------------------------
+*/
+
+/**
+* An empty filter that answers true for everything until reset().
+*/
+inline BloomFilter::BloomFilter() :
+    blockCount_(0), probes_(0), count_(0)
+{
+
+}
+
+inline BloomFilter::BloomFilter(size_t expectedKeys, double falsePositiveRate) :
+    blockCount_(0), probes_(0), count_(0)
+{
+  reset(expectedKeys, falsePositiveRate);
+}
+
+/**
+* Sizes the filter for expectedKeys at the given false-positive rate and
+* empties it. Blocking costs a little accuracy, so the bits per key get a
+* 20% allowance over the textbook -ln(p) / ln(2)^2.
+*/
+inline void BloomFilter::reset(size_t expectedKeys, double falsePositiveRate)
+{
+  if (falsePositiveRate <= 0.0 || falsePositiveRate >= 1.0)
+  {
+    falsePositiveRate = 0.01;
+  }
+  double ln2 = std::log(2.0);
+  double bitsPerKey = 1.2 * -std::log(falsePositiveRate) / (ln2 * ln2);
+  probes_ = static_cast<unsigned>(bitsPerKey / 1.2 * ln2 + 0.5);
+  if (probes_ < 1)
+    probes_ = 1;
+  if (probes_ > 16)
+    probes_ = 16;
+  size_t bits = static_cast<size_t>(bitsPerKey * (expectedKeys == 0 ? 1 : expectedKeys));
+  blockCount_ = (bits + 511) / 512;
+  //over-allocate one block so that the blocks can start on a cache line
+  words_.assign((blockCount_ + 1) * WORDS_PER_BLOCK, 0);
+  count_ = 0;
+}
+
+/**
+* Forgets every key, keeping the size.
+*/
+inline void BloomFilter::clear()
+{
+  std::fill(words_.begin(), words_.end(), 0);
+  count_ = 0;
+}
+
+/**
+* Sets the key's bits in its block, using the upper bits of the hash to
+* pick the block and double hashing on the lower 32 for the bit positions.
+*/
+inline void BloomFilter::add(uint64_t hash)
+{
+  if (blockCount_ == 0)
+    return;
+  uint64_t* words = const_cast<uint64_t*>(block(hash));
+  uint32_t h1 = static_cast<uint32_t>(hash);
+  uint32_t h2 = static_cast<uint32_t>(mix(hash) >> 32) | 1;
+  for (unsigned i = 0; i < probes_; i++)
+  {
+    uint32_t bit = (h1 + i * h2) & 511;
+    words[bit >> 6] |= uint64_t(1) << (bit & 63);
+  }
+  count_++;
+}
+
+/**
+* Returns false only if the key was never added.
+*/
+inline bool BloomFilter::mayContain(uint64_t hash) const
+{
+  if (blockCount_ == 0)
+    return true;
+  const uint64_t* words = block(hash);
+  uint32_t h1 = static_cast<uint32_t>(hash);
+  uint32_t h2 = static_cast<uint32_t>(mix(hash) >> 32) | 1;
+  for (unsigned i = 0; i < probes_; i++)
+  {
+    uint32_t bit = (h1 + i * h2) & 511;
+    if ((words[bit >> 6] & (uint64_t(1) << (bit & 63))) == 0)
+      return false;
+  }
+  return true;
+}
+
+/**
+* The number of add() calls since the last reset or clear.
+*/
+inline size_t BloomFilter::count() const
+{
+  return count_;
+}
+
+inline size_t BloomFilter::bytes() const
+{
+  return words_.size() * sizeof(uint64_t);
+}
+
+/**
+* A well-mixed 64-bit hash of key. std::hash is the identity for integers
+* on common libraries, which would put consecutive keys in one block.
+*/
+template <typename Key>
+uint64_t BloomFilter::hashOf(const Key& key)
+{
+  return mix(static_cast<uint64_t>(std::hash<Key>()(key)));
+}
+
+/**
+* The murmur3 64-bit finalizer.
+*/
+inline uint64_t BloomFilter::mix(uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/**
+* The block for a hash, chosen from its upper 32 bits. The first block
+* starts at the first cache line inside words_; that is worked out here
+* rather than stored so that copies of the filter stay correct.
+*/
+inline const uint64_t* BloomFilter::block(uint64_t hash) const
+{
+  size_t index = static_cast<size_t>(((hash >> 32) * blockCount_) >> 32);
+  uintptr_t base = reinterpret_cast<uintptr_t>(&words_[0]);
+  size_t offset = ((64 - base % 64) % 64) / sizeof(uint64_t);
+  return &words_[offset + index * WORDS_PER_BLOCK];
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the BloomFilter class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,1221 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <malloc.h>
+#include <dirent.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "slabavl.h"
+#include "smallavl.h"
+#include "chunkedavl.h"
+#include "flatmap.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "snapshot.h"
+#include "sharedavl.h"
+#include "lsmstore.h"
+#include "wal.h"
+#include "pagedbtree.h"
+#include "merkleavl.h"
+#include "indexedavl.h"
+
+using namespace std;
+
+/**
+ * Benchmarks for the search trees. Run with no arguments to run every
+ * benchmark, or pass the benchmark names to run a subset, e.g.
+ *   ./bst-bench layout slab
+ * An optional -n <count> sets the number of entries.
+ */
+
+// AVLNode layout before the balance moved into the parent pointer's tag bits
+template<typename Key, typename Value>
+struct UntaggedAVLNode : public Node<Key, Value>
+{
+  UntaggedAVLNode(const Key& key, const Value& value) :
+    Node<Key, Value>(key, value, NULL), balance_(0) { }
+  int8_t balance_;
+};
+
+typedef chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start)
+{
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// resident set size of this process in KiB, after returning freed heap pages
+static long rssKiB()
+{
+  malloc_trim(0);
+  ifstream statm("/proc/self/statm");
+  long pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static vector<int> shuffledKeys(size_t n, unsigned seed)
+{
+  vector<int> keys(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    keys[i] = static_cast<int>(i);
+  }
+  shuffle(keys.begin(), keys.end(), mt19937(seed));
+  return keys;
+}
+
+void benchLayout(size_t n)
+{
+  cout << "== layout (" << n << " entries)" << endl;
+  cout << "sizeof(Node<int,int>)            " << sizeof(Node<int, int>) << endl;
+  cout << "sizeof(untagged AVLNode<int,int>) " << sizeof(UntaggedAVLNode<int, int>) << endl;
+  cout << "sizeof(AVLNode<int,int>)         " << sizeof(AVLNode<int, int>) << endl;
+
+  vector<int> keys = shuffledKeys(n, 1);
+
+  // both populations stay alive so freed pages are not reused by the second
+  long before = rssKiB();
+  Clock::time_point start = Clock::now();
+  AVLTree<int, int> tree;
+  for (size_t i = 0; i < n; i++)
+  {
+    tree.insert(make_pair(keys[i], keys[i]));
+  }
+  double insertMs = msSince(start);
+  long taggedKiB = rssKiB() - before;
+
+  before = rssKiB();
+  vector<UntaggedAVLNode<int, int>*> untagged(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    untagged[i] = new UntaggedAVLNode<int, int>(keys[i], keys[i]);
+  }
+  long untaggedKiB = rssKiB() - before - static_cast<long>(n * sizeof(void*) / 1024);
+  for (size_t i = 0; i < n; i++)
+  {
+    delete untagged[i];
+  }
+
+  cout << "RSS growth, untagged nodes       " << untaggedKiB << " KiB" << endl;
+  cout << "RSS growth, AVLTree (tagged)     " << taggedKiB << " KiB" << endl;
+  cout << "AVLTree insert                   " << insertMs << " ms" << endl;
+}
+
+// a large, cold value as stored next to each key
+template<size_t N>
+struct Payload
+{
+  Payload() { data[0] = 0; }
+  explicit Payload(int seed) { data[0] = static_cast<char>(seed); }
+  char data[N];
+};
+
+// printRoot() is virtual, so every Value must be printable
+template<size_t N>
+ostream& operator<<(ostream& out, const Payload<N>& p)
+{
+  return out << static_cast<int>(p.data[0]);
+}
+
+// time random finds over every key in tree, returning a checksum to keep the loop alive
+template<typename Tree>
+long timeFinds(Tree& tree, const vector<int>& probes, double& ms)
+{
+  long sum = 0;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < probes.size(); i++)
+  {
+    if (tree.find(probes[i]) != tree.end())
+    {
+      sum++;
+    }
+  }
+  ms = msSince(start);
+  return sum;
+}
+
+template<size_t N>
+void benchSlabLookupSize(size_t n)
+{
+  vector<int> keys = shuffledKeys(n, 2);
+  vector<int> probes = shuffledKeys(n, 3);
+
+  AVLTree<int, Payload<N> > inlineTree;
+  SlabAVLTree<int, Payload<N> > slabTree;
+  for (size_t i = 0; i < n; i++)
+  {
+    inlineTree.insert(make_pair(keys[i], Payload<N>(keys[i])));
+    slabTree.insert(make_pair(keys[i], Payload<N>(keys[i])));
+  }
+
+  double inlineMs, slabMs;
+  long found = timeFinds(inlineTree, probes, inlineMs);
+  found += timeFinds(slabTree, probes, slabMs);
+  cout << N << "-byte values: AVLTree " << inlineMs << " ms, SlabAVLTree "
+       << slabMs << " ms (" << found << " hits)" << endl;
+}
+
+void benchSlabLookup(size_t n)
+{
+  // values are large, so keep the total footprint to a few hundred MB
+  n = min(n, static_cast<size_t>(200000));
+  cout << "== slab lookup (" << n << " entries)" << endl;
+  benchSlabLookupSize<200>(n);
+  benchSlabLookupSize<800>(n);
+  benchSlabLookupSize<2000>(n);
+}
+
+// fill n/entries maps with `entries` keys each, reporting time and RSS growth
+template<typename Map>
+void timeManyMaps(const char* label, size_t n, size_t entries)
+{
+  long before = rssKiB();
+  Clock::time_point start = Clock::now();
+  vector<Map> maps(n / entries);
+  for (size_t m = 0; m < maps.size(); m++)
+  {
+    for (size_t i = 0; i < entries; i++)
+    {
+      maps[m].insert(make_pair(static_cast<int>((i * 7) % entries), static_cast<int>(m)));
+    }
+  }
+  long hits = 0;
+  for (size_t m = 0; m < maps.size(); m++)
+  {
+    hits += (maps[m].find(static_cast<int>(m % entries)) != maps[m].end()) ? 1 : 0;
+  }
+  double ms = msSince(start);
+  cout << label << ": " << ms << " ms, RSS growth " << rssKiB() - before
+       << " KiB (" << hits << " hits)" << endl;
+}
+
+void benchSmallMaps(size_t n)
+{
+  //optional state lives behind AVLTree::Extras so that empty trees stay small
+  static_assert(sizeof(AVLTree<int, int>) <= 64, "AVLTree<int,int> grew past 64 bytes");
+  cout << "== many small maps (" << n << " entries total)" << endl;
+  cout << "sizeof(AVLTree<int,int>)          " << sizeof(AVLTree<int, int>) << endl;
+  cout << "sizeof(SmallAVLTree<int,int,8>)   " << sizeof(SmallAVLTree<int, int, 8>) << endl;
+  size_t sizes[] = { 2, 6, 16 };
+  for (size_t s = 0; s < 3; s++)
+  {
+    cout << sizes[s] << " entries per map" << endl;
+    timeManyMaps<AVLTree<int, int> >("  AVLTree            ", n, sizes[s]);
+    timeManyMaps<SmallAVLTree<int, int, 8> >("  SmallAVLTree<.., 8>", n, sizes[s]);
+  }
+}
+
+// find and scan timings for any map with the BinarySearchTree interface
+template<typename Map>
+void timeReads(const char* label, Map& map, double insertMs, const vector<int>& probes)
+{
+  double findMs;
+  long found = timeFinds(map, probes, findMs);
+
+  Clock::time_point start = Clock::now();
+  long sum = 0;
+  for (typename Map::iterator it = map.begin(); it != map.end(); ++it)
+  {
+    sum += it->second;
+  }
+  double scanMs = msSince(start);
+
+  cout << label << ": insert " << insertMs << " ms, find " << findMs
+       << " ms, scan " << scanMs << " ms (" << found << " hits, sum " << sum << ")" << endl;
+}
+
+// insert, find and scan timings, inserting one key at a time
+template<typename Map>
+void timeMapOps(const char* label, Map& map, const vector<int>& keys, const vector<int>& probes)
+{
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    map.insert(make_pair(keys[i], keys[i]));
+  }
+  timeReads(label, map, msSince(start), probes);
+}
+
+void benchChunked(size_t n)
+{
+  cout << "== chunked AVL (" << n << " entries)" << endl;
+  vector<int> keys = shuffledKeys(n, 4);
+  vector<int> probes = shuffledKeys(n, 5);
+  {
+    AVLTree<int, int> tree;
+    timeMapOps("AVLTree                  ", tree, keys, probes);
+  }
+  {
+    ChunkedAVLTree<int, int, 32> tree;
+    timeMapOps("ChunkedAVLTree<int,int,32>", tree, keys, probes);
+    cout << "  " << tree.chunkCount() << " chunk nodes" << endl;
+  }
+}
+
+void benchFlat(size_t n)
+{
+  n = min(n, static_cast<size_t>(100000));
+  cout << "== flat map (" << n << " entries)" << endl;
+  vector<int> keys = shuffledKeys(n, 6);
+  vector<int> probes = shuffledKeys(n, 7);
+  {
+    AVLTree<int, int> tree;
+    timeMapOps("AVLTree         ", tree, keys, probes);
+  }
+  {
+    FlatMap<int, int> flat;
+    vector<pair<int, int> > batch;
+    for (size_t i = 0; i < n; i++)
+    {
+      batch.push_back(make_pair(keys[i], keys[i]));
+    }
+    Clock::time_point start = Clock::now();
+    flat.insert(batch.begin(), batch.end());
+    timeReads("FlatMap (batched)", flat, msSince(start), probes);
+  }
+  {
+    // single inserts shift the tail; keep this run small
+    size_t small = min(n, static_cast<size_t>(20000));
+    vector<int> smallKeys(keys.begin(), keys.begin() + small);
+    FlatMap<int, int> flat;
+    timeMapOps("FlatMap (single, first 20k)", flat, smallKeys, probes);
+  }
+}
+
+// preload n keys, then run n operations with the given percentage of writes
+// (half inserts, half removes) and the rest lookups
+template<typename Tree>
+void timeMixed(const char* label, size_t n, int writePercent)
+{
+  Tree tree;
+  vector<int> keys = shuffledKeys(n, 8);
+  for (size_t i = 0; i < n; i++)
+  {
+    tree.insert(make_pair(keys[i], keys[i]));
+  }
+
+  mt19937 rng(9);
+  long hits = 0;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < n; i++)
+  {
+    int key = static_cast<int>(rng() % (2 * n));
+    int dice = static_cast<int>(rng() % 100);
+    if (dice < writePercent / 2)
+    {
+      tree.insert(make_pair(key, key));
+    }
+    else if (dice < writePercent)
+    {
+      tree.remove(key);
+    }
+    else
+    {
+      hits += (tree.find(key) != tree.end()) ? 1 : 0;
+    }
+  }
+  cout << label << writePercent << "% writes: " << msSince(start) << " ms ("
+       << hits << " hits)" << endl;
+}
+
+void benchRedBlack(size_t n)
+{
+  cout << "== red-black vs AVL, mixed (" << n << " preloaded, " << n << " ops)" << endl;
+  int writeMixes[] = { 10, 50, 90 };
+  for (size_t w = 0; w < 3; w++)
+  {
+    timeMixed<AVLTree<int, int> >("  AVLTree ", n, writeMixes[w]);
+    timeMixed<RBTree<int, int> >("  RBTree  ", n, writeMixes[w]);
+  }
+}
+
+// count probes drawn from a Zipf(s) distribution over the keys; rank r is
+// drawn with probability proportional to 1 / r^s and mapped to a random key
+static vector<int> zipfProbes(const vector<int>& keys, size_t count, double s, unsigned seed)
+{
+  vector<double> cdf(keys.size());
+  double total = 0;
+  for (size_t r = 0; r < keys.size(); r++)
+  {
+    total += 1.0 / pow(static_cast<double>(r + 1), s);
+    cdf[r] = total;
+  }
+  mt19937 rng(seed);
+  uniform_real_distribution<double> uniform(0, total);
+  vector<int> probes(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t rank = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+    probes[i] = keys[min(rank, keys.size() - 1)];
+  }
+  return probes;
+}
+
+void benchZipf(size_t n)
+{
+  cout << "== Zipf lookups (" << n << " keys, " << n << " probes)" << endl;
+  vector<int> keys = shuffledKeys(n, 10);
+  AVLTree<int, int> avl;
+  SplayTree<int, int> splay;
+  for (size_t i = 0; i < n; i++)
+  {
+    avl.insert(make_pair(keys[i], keys[i]));
+    splay.insert(make_pair(keys[i], keys[i]));
+  }
+  double skews[] = { 0.0, 0.8, 0.99, 1.2, 1.5 };
+  for (size_t z = 0; z < 5; z++)
+  {
+    vector<int> probes = zipfProbes(keys, n, skews[z], 11);
+    double avlMs, splayMs;
+    long hits = timeFinds(avl, probes, avlMs);
+    hits += timeFinds(splay, probes, splayMs);
+    cout << "s=" << skews[z] << ": AVLTree " << avlMs << " ms, SplayTree " << splayMs
+         << " ms (" << hits << " hits)" << endl;
+  }
+}
+
+// time each insert of a burst into a preloaded tree, reporting percentiles
+static void timeBurst(const char* label, AVLTree<int, int>& tree, const vector<int>& burst)
+{
+  vector<double> latencies(burst.size());
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < burst.size(); i++)
+  {
+    Clock::time_point opStart = Clock::now();
+    tree.insert(make_pair(burst[i], burst[i]));
+    latencies[i] = chrono::duration<double, micro>(Clock::now() - opStart).count();
+  }
+  double totalMs = msSince(start);
+  sort(latencies.begin(), latencies.end());
+  cout << label << ": " << totalMs << " ms, p50 " << latencies[latencies.size() / 2]
+       << " us, p99 " << latencies[latencies.size() * 99 / 100] << " us, max "
+       << latencies.back() << " us" << endl;
+}
+
+static void timeRelaxedBurst(const vector<int>& preload, const vector<int>& burst)
+{
+  {
+    AVLTree<int, int> tree;
+    for (size_t i = 0; i < preload.size(); i++)
+      tree.insert(make_pair(preload[i], preload[i]));
+    timeBurst("  strict ", tree, burst);
+  }
+  {
+    AVLTree<int, int> tree;
+    for (size_t i = 0; i < preload.size(); i++)
+      tree.insert(make_pair(preload[i], preload[i]));
+    tree.setRelaxed(true);
+    timeBurst("  relaxed", tree, burst);
+    Clock::time_point start = Clock::now();
+    tree.setRelaxed(false);
+    cout << "  rebalance after burst: " << msSince(start) << " ms" << endl;
+  }
+}
+
+void benchRelaxed(size_t n)
+{
+  cout << "== relaxed AVL insert burst (" << n / 2 << " preloaded, " << n / 2 << " burst)" << endl;
+  vector<int> keys = shuffledKeys(n, 12);
+  vector<int> preload(keys.begin(), keys.begin() + n / 2);
+  vector<int> burst(keys.begin() + n / 2, keys.end());
+  cout << "random burst" << endl;
+  timeRelaxedBurst(preload, burst);
+
+  // ascending keys past the preloaded range, as in an append-heavy ingest
+  for (size_t i = 0; i < preload.size(); i++)
+    preload[i] = static_cast<int>(i);
+  for (size_t i = 0; i < burst.size(); i++)
+    burst[i] = static_cast<int>(preload.size() + i);
+  cout << "ascending burst" << endl;
+  timeRelaxedBurst(preload, burst);
+}
+
+// remove half the keys in random order, look up every key once, then
+// insert the removed keys again (which revives tombstones in lazy mode)
+static void timeRemoves(const char* label, bool lazy, const vector<int>& keys, const vector<int>& victims)
+{
+  AVLTree<int, int> tree;
+  for (size_t i = 0; i < keys.size(); i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  tree.setLazyRemove(lazy);
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < victims.size(); i++)
+    tree.remove(victims[i]);
+  double removeMs = msSince(start);
+  start = Clock::now();
+  size_t hits = 0;
+  for (size_t i = 0; i < keys.size(); i++)
+    hits += (tree.find(keys[i]) != tree.end());
+  double findMs = msSince(start);
+  size_t tombstones = tree.tombstoneCount();
+  start = Clock::now();
+  for (size_t i = 0; i < victims.size(); i++)
+    tree.insert(make_pair(victims[i], victims[i]));
+  cout << label << ": remove " << removeMs << " ms, find " << findMs << " ms, reinsert "
+       << msSince(start) << " ms (" << hits << " hits, " << tombstones << " tombstones)" << endl;
+}
+
+void benchLazy(size_t n)
+{
+  cout << "== AVL remove, eager vs tombstones (" << n << " keys, " << n / 2 << " removes)" << endl;
+  vector<int> keys = shuffledKeys(n, 13);
+  vector<int> victims = shuffledKeys(n, 14);
+  victims.resize(n / 2);
+  timeRemoves("  eager", false, keys, victims);
+  timeRemoves("  lazy ", true, keys, victims);
+}
+
+// one find per key against findBatch over multi-get requests of batch keys
+static void timeBatchFinds(size_t n, size_t batch)
+{
+  AVLTree<int, int> tree;
+  vector<int> keys = shuffledKeys(n, 15);
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  vector<int> probes = shuffledKeys(n, 16);
+  probes.resize(min(n, static_cast<size_t>(1000000)));
+
+  Clock::time_point start = Clock::now();
+  size_t hits = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    hits += (tree.find(probes[i]) != tree.end());
+  double singleMs = msSince(start);
+
+  vector<int> request;
+  vector<AVLTree<int, int>::iterator> results;
+  start = Clock::now();
+  size_t batchHits = 0;
+  for (size_t i = 0; i < probes.size(); i += batch)
+  {
+    request.assign(probes.begin() + i, probes.begin() + min(i + batch, probes.size()));
+    tree.findBatch(request, results);
+    for (size_t j = 0; j < results.size(); j++)
+      batchHits += (results[j] != tree.end());
+  }
+  double batchMs = msSince(start);
+  cout << "  " << n << " keys: find " << singleMs << " ms, findBatch " << batchMs
+       << " ms, " << singleMs / batchMs << "x (" << hits << "/" << batchHits << " hits)" << endl;
+}
+
+void benchBatch(size_t n)
+{
+  cout << "== AVL multi-get, 256 keys per findBatch" << endl;
+  timeBatchFinds(n / 16, 256);
+  timeBatchFinds(n, 256);
+  timeBatchFinds(4 * n, 256);
+}
+
+// m sorted probes (half of them hits): find per key, findBatch, findSorted
+static void timeSortedFinds(const AVLTree<int, int>& tree, size_t n, size_t m)
+{
+  vector<int> probes = shuffledKeys(2 * n, 17);
+  probes.resize(m);
+  sort(probes.begin(), probes.end());
+
+  Clock::time_point start = Clock::now();
+  size_t hits = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    hits += (tree.find(probes[i]) != tree.end());
+  double singleMs = msSince(start);
+
+  vector<AVLTree<int, int>::iterator> results;
+  start = Clock::now();
+  tree.findBatch(probes, results);
+  double batchMs = msSince(start);
+
+  results.resize(m);
+  start = Clock::now();
+  tree.findSorted(probes.begin(), probes.end(), results.begin());
+  double sortedMs = msSince(start);
+  size_t sortedHits = 0;
+  for (size_t i = 0; i < results.size(); i++)
+    sortedHits += (results[i] != tree.end());
+  cout << "  m = " << m << ": find " << singleMs << " ms, findBatch " << batchMs
+       << " ms, findSorted " << sortedMs << " ms (" << hits << "/" << sortedHits << " hits)" << endl;
+}
+
+void benchSorted(size_t n)
+{
+  cout << "== AVL sorted multi-find (" << n << " keys)" << endl;
+  AVLTree<int, int> tree;
+  vector<int> keys = shuffledKeys(2 * n, 15);
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  for (size_t m = n / 1000; m <= 2 * n; m *= 10)
+    timeSortedFinds(tree, n, m);
+}
+
+// move every other key of a tree into a second tree
+static void timeMove(const char* label, bool useHandles, const vector<int>& keys)
+{
+  AVLTree<int, string> from;
+  AVLTree<int, string> to;
+  for (size_t i = 0; i < keys.size(); i++)
+    from.insert(make_pair(keys[i], string(100, 'x')));
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < keys.size(); i += 2)
+  {
+    if (useHandles)
+    {
+      to.insert(from.extract(keys[i]));
+    }
+    else
+    {
+      to.insert(make_pair(keys[i], from[keys[i]]));
+      from.remove(keys[i]);
+    }
+  }
+  cout << label << ": " << msSince(start) << " ms (" << from.size() << " + " << to.size() << ")" << endl;
+}
+
+void benchMove(size_t n)
+{
+  cout << "== moving " << n / 2 << " entries (100-char string values) between AVL trees" << endl;
+  vector<int> keys = shuffledKeys(n, 18);
+  timeMove("  copy + remove ", false, keys);
+  timeMove("  extract/insert", true, keys);
+}
+
+// scan the tree and drop every key divisible by 3, as in an expiration sweep
+static void timeSweep(const char* label, bool useErase, const vector<int>& keys)
+{
+  AVLTree<int, int> tree;
+  for (size_t i = 0; i < keys.size(); i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  Clock::time_point start = Clock::now();
+  if (useErase)
+  {
+    for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); )
+    {
+      if (it->first % 3 == 0)
+        it = tree.erase(it);
+      else
+        ++it;
+    }
+  }
+  else
+  {
+    vector<int> expired;
+    for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it)
+    {
+      if (it->first % 3 == 0)
+        expired.push_back(it->first);
+    }
+    for (size_t i = 0; i < expired.size(); i++)
+      tree.remove(expired[i]);
+  }
+  cout << label << ": " << msSince(start) << " ms (" << tree.size() << " left)" << endl;
+}
+
+void benchSweep(size_t n)
+{
+  cout << "== AVL expiration sweep (" << n << " keys, a third expire)" << endl;
+  vector<int> keys = shuffledKeys(n, 19);
+  timeSweep("  collect + remove(key)", false, keys);
+  timeSweep("  erase(iterator)      ", true, keys);
+}
+
+void benchCopy(size_t n)
+{
+  cout << "== copying an AVL tree (" << n << " keys)" << endl;
+  AVLTree<int, int> tree;
+  vector<int> keys = shuffledKeys(n, 20);
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+
+  Clock::time_point start = Clock::now();
+  AVLTree<int, int> reinserted;
+  for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it)
+    reinserted.insert(*it);
+  cout << "  re-insert:  " << msSince(start) << " ms" << endl;
+
+  start = Clock::now();
+  AVLTree<int, int> copy(tree);
+  cout << "  copy:       " << msSince(start) << " ms" << endl;
+
+  start = Clock::now();
+  AVLTree<int, int> moved(std::move(copy));
+  cout << "  move:       " << msSince(start) << " ms (" << moved.size() << " keys)" << endl;
+}
+
+// merge a delta of m keys (a tenth of them already present) into n keys
+static void timeMerge(const vector<int>& keys, size_t n, size_t m)
+{
+  double insertMs = 0, mergeMs = 0;
+  for (int useMerge = 0; useMerge < 2; useMerge++)
+  {
+    AVLTree<int, int> tree;
+    AVLTree<int, int> delta;
+    for (size_t i = 0; i < n; i++)
+      tree.insert(make_pair(keys[i], keys[i]));
+    for (size_t i = n - m / 10; i < n - m / 10 + m; i++)
+      delta.insert(make_pair(keys[i], -keys[i]));
+    Clock::time_point start = Clock::now();
+    if (useMerge)
+    {
+      tree.merge(std::move(delta));
+      mergeMs = msSince(start);
+    }
+    else
+    {
+      for (AVLTree<int, int>::iterator it = delta.begin(); it != delta.end(); ++it)
+        tree.insert(*it);
+      insertMs = msSince(start);
+    }
+  }
+  cout << "  m = " << m << ": insert each " << insertMs << " ms, merge " << mergeMs << " ms" << endl;
+}
+
+void benchMerge(size_t n)
+{
+  cout << "== merging a delta AVL tree into " << n << " keys" << endl;
+  vector<int> keys = shuffledKeys(2 * n, 21);
+  for (size_t m = n / 1000; m <= n; m *= 10)
+    timeMerge(keys, n, m);
+}
+
+// in-order scan time and the successor-distance metric
+static void reportScan(const char* label, const AVLTree<int, int>& tree)
+{
+  Clock::time_point start = Clock::now();
+  long sum = 0;
+  for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it)
+    sum += it->second;
+  double scanMs = msSince(start);
+  cout << label << ": scan " << scanMs << " ms, mean successor distance "
+       << static_cast<long>(tree.meanSuccessorDistance()) << " bytes (sum " << sum << ")" << endl;
+}
+
+// fill a tree with n keys, then replace every key, a random one at a time
+static void churn(AVLTree<int, int>& tree, const vector<int>& keys, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  mt19937 rng(23);
+  vector<int> live(keys.begin(), keys.begin() + n);
+  for (size_t i = n; i < 2 * n; i++)
+  {
+    size_t victim = rng() % live.size();
+    tree.remove(live[victim]);
+    live[victim] = keys[i];
+    tree.insert(make_pair(keys[i], keys[i]));
+  }
+}
+
+void benchDefrag(size_t n)
+{
+  cout << "== AVL defragment after churn (" << n << " keys)" << endl;
+  vector<int> keys = shuffledKeys(2 * n, 22);
+  {
+    AVLTree<int, int> tree;
+    churn(tree, keys, n);
+    reportScan("  churned   ", tree);
+    Clock::time_point start = Clock::now();
+    tree.defragment();
+    double defragMs = msSince(start);
+    reportScan("  defragged ", tree);
+    cout << "  defragment: " << defragMs << " ms" << endl;
+  }
+  {
+    AVLTree<int, int> tree;
+    churn(tree, keys, n);
+    Clock::time_point start = Clock::now();
+    for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); )
+      it = tree.defragment(it, 4096);
+    double defragMs = msSince(start);
+    reportScan("  in steps  ", tree);
+    cout << "  defragment: " << defragMs << " ms in steps of 4096" << endl;
+  }
+}
+
+void benchSnapshot(size_t n)
+{
+  cout << "== mapped snapshot vs AVL tree (" << n << " keys)" << endl;
+  AVLTree<int, int> tree;
+  vector<int> keys = shuffledKeys(n, 24);
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  vector<int> probes = shuffledKeys(n, 25);
+  const string path = "bst-bench.snap";
+
+  for (int withIndex = 0; withIndex < 2; withIndex++)
+  {
+    Clock::time_point start = Clock::now();
+    MappedSnapshot<int, int>::save(tree, path, withIndex ? MappedSnapshot<int, int>::DEFAULT_FENCE_STRIDE : 0);
+    double saveMs = msSince(start);
+    MappedSnapshot<int, int> snap;
+    start = Clock::now();
+    snap.load(path);
+    double loadMs = msSince(start);
+    start = Clock::now();
+    long sum = 0;
+    for (size_t i = 0; i < probes.size(); i++)
+      sum += snap.find(probes[i])->second;
+    double findMs = msSince(start);
+    cout << (withIndex ? "  fenced:    " : "  no index:  ") << "save " << saveMs << " ms, load " << loadMs
+         << " ms, finds " << findMs << " ms (sum " << sum << ")" << endl;
+  }
+  unlink(path.c_str());
+
+  Clock::time_point start = Clock::now();
+  long sum = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    sum += tree.find(probes[i])->second;
+  cout << "  AVL tree:  finds " << msSince(start) << " ms (sum " << sum << ")" << endl;
+}
+
+void benchShared(size_t n)
+{
+  cout << "== shared-memory AVL tree vs AVL tree (" << n << " keys)" << endl;
+  vector<int> keys = shuffledKeys(n, 26);
+  vector<int> probes = shuffledKeys(n, 27);
+  const string path = "bst-bench.shm";
+
+  long before = rssKiB();
+  Clock::time_point start = Clock::now();
+  AVLTree<int, int> tree;
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  double insertMs = msSince(start);
+  long treeKiB = rssKiB() - before;
+  start = Clock::now();
+  long sum = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    sum += tree.find(probes[i])->second;
+  cout << "  AVL tree:    insert " << insertMs << " ms, finds " << msSince(start) << " ms, "
+       << treeKiB << " KiB per process (sum " << sum << ")" << endl;
+
+  SharedAVLTree<int, int> writer;
+  writer.create(path, n);
+  start = Clock::now();
+  for (size_t i = 0; i < n; i++)
+    writer.insert(make_pair(keys[i], keys[i]));
+  insertMs = msSince(start);
+  SharedAVLTree<int, int> reader;
+  reader.attach(path);
+  start = Clock::now();
+  sum = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+  {
+    int value = 0;
+    reader.lookup(probes[i], value);
+    sum += value;
+  }
+  cout << "  shared tree: insert " << insertMs << " ms, finds " << msSince(start) << " ms, "
+       << writer.regionBytes() / 1024 << " KiB once per host (sum " << sum << ")" << endl;
+  unlink(path.c_str());
+}
+
+// delete a flat directory of files, as left behind by LSMStore
+static void removeDir(const string& dir)
+{
+  DIR* listing = opendir(dir.c_str());
+  if (listing == NULL)
+    return;
+  while (struct dirent* entry = readdir(listing))
+  {
+    string name = entry->d_name;
+    if (name != "." && name != "..")
+      unlink((dir + "/" + name).c_str());
+  }
+  closedir(listing);
+  rmdir(dir.c_str());
+}
+
+void benchLsm(size_t n)
+{
+  cout << "== LSM store vs AVL tree (" << n << " keys, memtable " << n / 16 << ")" << endl;
+  vector<int> keys = shuffledKeys(2 * n, 28);
+  vector<int> hits(keys.begin(), keys.begin() + n);
+  vector<int> misses(keys.begin() + n, keys.end());
+  random_shuffle(hits.begin(), hits.end());
+  const string dir = "bst-bench.lsm";
+  removeDir(dir);
+
+  long before = rssKiB();
+  Clock::time_point start = Clock::now();
+  AVLTree<int, int> tree;
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  double insertMs = msSince(start);
+  long treeKiB = rssKiB() - before;
+  start = Clock::now();
+  long sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += tree.find(hits[i])->second;
+  double hitMs = msSince(start);
+  start = Clock::now();
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++)
+    found += (tree.find(misses[i]) != tree.end());
+  cout << "  AVL tree: insert " << insertMs << " ms, hits " << hitMs << " ms, misses "
+       << msSince(start) << " ms, " << treeKiB << " KiB (sum " << sum << ", " << found << " false)" << endl;
+
+  {
+    before = rssKiB();
+    LSMStore<int, int> store(dir, n / 16, 4);
+    start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+      store.insert(make_pair(keys[i], keys[i]));
+    insertMs = msSince(start);
+    store.flush();
+    store.waitForCompaction();
+    long storeKiB = rssKiB() - before;
+    start = Clock::now();
+    sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      int value = 0;
+      store.lookup(hits[i], value);
+      sum += value;
+    }
+    hitMs = msSince(start);
+    size_t skipsBefore = store.bloomSkips();
+    start = Clock::now();
+    found = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      int value;
+      found += store.lookup(misses[i], value);
+    }
+    cout << "  LSM:      insert " << insertMs << " ms, hits " << hitMs << " ms, misses "
+         << msSince(start) << " ms, " << storeKiB << " KiB resident, " << store.runCount()
+         << " runs (sum " << sum << ", " << found << " false, " << store.bloomSkips() - skipsBefore
+         << " run searches skipped)" << endl;
+  }
+  removeDir(dir);
+}
+
+// durable inserts of count keys spread over the given number of threads
+static void timeLoggedInserts(const string& dir, const vector<int>& keys, size_t count, int threads)
+{
+  removeDir(dir);
+  LoggedAVLTree<int, int> tree(dir);
+  Clock::time_point start = Clock::now();
+  vector<thread> writers;
+  for (int t = 0; t < threads; t++)
+  {
+    writers.push_back(thread([&tree, &keys, count, threads, t]()
+    {
+      for (size_t i = t; i < count; i += threads)
+        tree.insert(make_pair(keys[i], keys[i]));
+    }));
+  }
+  for (size_t t = 0; t < writers.size(); t++)
+    writers[t].join();
+  double ms = msSince(start);
+  cout << "  " << threads << " writer(s): " << count / ms * 1000 << " inserts/s, "
+       << tree.log().syncCount() << " syncs for " << count << " records" << endl;
+}
+
+void benchWal(size_t n)
+{
+  size_t durable = min(n, static_cast<size_t>(20000));
+  cout << "== logged AVL tree (" << durable << " durable inserts, replay of " << n << " records)" << endl;
+  vector<int> keys = shuffledKeys(n, 29);
+  const string dir = "bst-bench.wal";
+  timeLoggedInserts(dir, keys, durable, 1);
+  timeLoggedInserts(dir, keys, durable, 8);
+
+  //build a log of n records without waiting on each sync
+  removeDir(dir);
+  mkdir(dir.c_str(), 0755);
+  {
+    WriteAheadLog<int, int> log(dir + "/wal.log");
+    for (size_t i = 0; i < n; i++)
+      log.append(WriteAheadLog<int, int>::INSERT, keys[i], keys[i]);
+  }
+  Clock::time_point start = Clock::now();
+  AVLTree<int, int> perRecord;
+  for (size_t i = 0; i < n; i++)
+    perRecord.insert(make_pair(keys[i], keys[i]));
+  cout << "  per-record inserts: " << msSince(start) << " ms" << endl;
+  start = Clock::now();
+  size_t replayed;
+  {
+    LoggedAVLTree<int, int> tree(dir);
+    replayed = tree.replayedRecords();
+  }
+  cout << "  replay:             " << msSince(start) << " ms (" << replayed << " records)" << endl;
+  removeDir(dir);
+}
+
+static void timePagedTree(const char* label, size_t cacheBytes, const vector<int>& keys, const vector<int>& probes)
+{
+  const string path = "bst-bench.btree";
+  unlink(path.c_str());
+  PagedBTree<int, int> tree(path, cacheBytes);
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  double insertMs = msSince(start);
+  start = Clock::now();
+  long sum = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    sum += tree.find(probes[i])->second;
+  double findMs = msSince(start);
+  start = Clock::now();
+  size_t absent = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    absent += tree.find(-1 - probes[i]) == tree.end();
+  double missMs = msSince(start);
+  start = Clock::now();
+  size_t scanned = 0;
+  for (PagedBTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it)
+    scanned++;
+  double scanMs = msSince(start);
+  cout << label << "inserts " << insertMs << " ms, finds " << findMs << " ms, misses " << missMs
+       << " ms, scan " << scanMs << " ms (sum " << sum << ", " << absent << " absent, " << scanned << " scanned)" << endl;
+  cout << "    " << tree.pool().pageCount() << " pages in the file, " << tree.pool().frameCount() << " frames; "
+       << tree.pool().hits() << " hits, " << tree.pool().misses() << " misses, "
+       << tree.pool().writes() << " page writes" << endl;
+  unlink(path.c_str());
+}
+
+void benchBTree(size_t n)
+{
+  cout << "== paged B+ tree vs AVL tree (" << n << " keys)" << endl;
+  vector<int> keys = shuffledKeys(n, 31);
+  vector<int> probes = shuffledKeys(n, 32);
+  //about a quarter of the leaves fit in the small cache
+  size_t smallCache = max(n * 2 * sizeof(int) / 4, static_cast<size_t>(64 * 1024));
+  timePagedTree("  capped pool: ", smallCache, keys, probes);
+  timePagedTree("  ample pool:  ", n * 8 * sizeof(int), keys, probes);
+
+  AVLTree<int, int> tree;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  double insertMs = msSince(start);
+  start = Clock::now();
+  long sum = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    sum += tree.find(probes[i])->second;
+  cout << "  AVL tree:    inserts " << insertMs << " ms, finds " << msSince(start) << " ms (sum " << sum << ")" << endl;
+}
+
+static void timeDiff(const MerkleAVLTree<int, int>& base, size_t n, size_t changes)
+{
+  MerkleAVLTree<int, int> replica(base);
+  vector<int> victims = shuffledKeys(n, 35);
+  for (size_t i = 0; i < changes; i++)
+  {
+    if (i % 2 == 0)
+      replica.insert(make_pair(victims[i], -1));
+    else
+      replica.remove(victims[i]);
+  }
+  Clock::time_point start = Clock::now();
+  size_t scanned = 0;
+  MerkleAVLTree<int, int>::iterator a = base.begin();
+  MerkleAVLTree<int, int>::iterator b = replica.begin();
+  while (a != base.end() && b != replica.end())
+  {
+    if (a->first < b->first)
+    {
+      scanned++;
+      ++a;
+    }
+    else if (b->first < a->first)
+    {
+      scanned++;
+      ++b;
+    }
+    else
+    {
+      scanned += !(a->second == b->second);
+      ++a;
+      ++b;
+    }
+  }
+  double scanMs = msSince(start);
+  start = Clock::now();
+  vector<int> keys = diff(base, replica);
+  cout << "  " << changes << " changes: full scan " << scanMs << " ms (" << scanned << " found), diff "
+       << msSince(start) << " ms (" << keys.size() << " found)" << endl;
+}
+
+void benchMerkle(size_t n)
+{
+  cout << "== subtree digests (" << n << " keys)" << endl;
+  vector<int> keys = shuffledKeys(n, 34);
+  Clock::time_point start = Clock::now();
+  AVLTree<int, int> plain;
+  for (size_t i = 0; i < n; i++)
+    plain.insert(make_pair(keys[i], keys[i]));
+  double plainMs = msSince(start);
+  start = Clock::now();
+  MerkleAVLTree<int, int> tree;
+  for (size_t i = 0; i < n; i++)
+    tree.insert(make_pair(keys[i], keys[i]));
+  double merkleMs = msSince(start);
+  start = Clock::now();
+  tree.digest();
+  cout << "  inserts: AVLTree " << plainMs << " ms, MerkleAVLTree " << merkleMs
+       << " ms, first digest " << msSince(start) << " ms" << endl;
+  timeDiff(tree, n, 1);
+  timeDiff(tree, n, 100);
+  timeDiff(tree, n, 10000);
+}
+
+static void timeFilteredFinds(const char* label, AVLTree<int, int>& tree, const vector<int>& probes, double insertMs)
+{
+  size_t skipsBefore = tree.bloomSkips();
+  Clock::time_point start = Clock::now();
+  size_t hits = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    hits += tree.find(probes[i]) != tree.end();
+  double findMs = msSince(start);
+  cout << label << "inserts " << insertMs << " ms, finds " << findMs << " ms (" << hits << " hits, "
+       << tree.bloomSkips() - skipsBefore << " descents skipped, filter " << tree.bloomBytes() / 1024 << " KiB)" << endl;
+}
+
+void benchBloom(size_t n)
+{
+  cout << "== bloom filter in front of AVL finds (" << n << " keys, 70% of finds miss)" << endl;
+  //even keys are present, odd ones miss
+  vector<int> keys = shuffledKeys(n, 36);
+  for (size_t i = 0; i < n; i++)
+    keys[i] *= 2;
+  vector<int> probes = shuffledKeys(n, 37);
+  mt19937 rng(38);
+  for (size_t i = 0; i < n; i++)
+    probes[i] = (rng() % 10 < 3) ? 2 * probes[i] : 2 * probes[i] + 1;
+
+  const double rates[] = { 0.0, 0.01, 0.1 };
+  for (double rate : rates)
+  {
+    AVLTree<int, int> tree;
+    if (rate > 0.0)
+      tree.setBloomFilter(true, rate);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+      tree.insert(make_pair(keys[i], keys[i]));
+    double insertMs = msSince(start);
+    string label = rate > 0.0 ? "  fpr " + to_string(rate).substr(0, 4) + ":  " : "  no filter: ";
+    timeFilteredFinds(label.c_str(), tree, probes, insertMs);
+  }
+}
+
+template <class Map>
+void timeIndexedOps(const char* label, const vector<int>& keys, const vector<int>& probes)
+{
+  long before = rssKiB();
+  Map map;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++)
+    map.insert(make_pair(keys[i], keys[i]));
+  double insertMs = msSince(start);
+  long kib = rssKiB() - before;
+  start = Clock::now();
+  long sum = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    sum += map.find(probes[i])->second;
+  double hitMs = msSince(start);
+  start = Clock::now();
+  size_t absent = 0;
+  for (size_t i = 0; i < probes.size(); i++)
+    absent += map.find(probes[i] + 1) == map.end();
+  double missMs = msSince(start);
+  start = Clock::now();
+  for (size_t i = 0; i < probes.size(); i++)
+    map.insert(make_pair(probes[i], probes[i] + 1));
+  double overwriteMs = msSince(start);
+  start = Clock::now();
+  for (typename Map::iterator it = map.begin(); it != map.end(); ++it)
+    sum += it->second;
+  double scanMs = msSince(start);
+  start = Clock::now();
+  for (size_t i = 0; i < probes.size(); i += 2)
+    map.remove(probes[i]);
+  double removeMs = msSince(start);
+  cout << label << "inserts " << insertMs << " ms, hits " << hitMs << " ms, misses " << missMs
+       << " ms, overwrites " << overwriteMs << " ms, scan " << scanMs << " ms, removes (half) " << removeMs
+       << " ms, " << kib / 1024 << " MiB (sum " << sum << ", " << absent << " absent)" << endl;
+}
+
+void benchIndexed(size_t n)
+{
+  cout << "== hash-indexed AVL map vs AVL tree (" << n << " keys)" << endl;
+  //even keys, so that odd probes miss all over the tree
+  vector<int> keys = shuffledKeys(n, 39);
+  vector<int> probes = shuffledKeys(n, 40);
+  for (size_t i = 0; i < n; i++)
+  {
+    keys[i] *= 2;
+    probes[i] *= 2;
+  }
+  timeIndexedOps<AVLTree<int, int> >("  AVLTree:       ", keys, probes);
+  timeIndexedOps<IndexedAVLMap<int, int> >("  IndexedAVLMap: ", keys, probes);
+}
+
+struct Benchmark
+{
+  const char* name;
+  void (*run)(size_t n);
+};
+
+static const Benchmark BENCHMARKS[] = {
+  { "layout", benchLayout },
+  { "slab", benchSlabLookup },
+  { "small", benchSmallMaps },
+  { "chunked", benchChunked },
+  { "flat", benchFlat },
+  { "rb", benchRedBlack },
+  { "zipf", benchZipf },
+  { "relaxed", benchRelaxed },
+  { "lazy", benchLazy },
+  { "batch", benchBatch },
+  { "sorted", benchSorted },
+  { "move", benchMove },
+  { "sweep", benchSweep },
+  { "copy", benchCopy },
+  { "merge", benchMerge },
+  { "defrag", benchDefrag },
+  { "snapshot", benchSnapshot },
+  { "shared", benchShared },
+  { "lsm", benchLsm },
+  { "wal", benchWal },
+  { "btree", benchBTree },
+  { "merkle", benchMerkle },
+  { "bloom", benchBloom },
+  { "indexed", benchIndexed },
+};
+
+int main(int argc, char *argv[])
+{
+  size_t n = 1000000;
+  vector<string> selected;
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc)
+    {
+      n = strtoul(argv[++i], NULL, 10);
+    }
+    else
+    {
+      selected.push_back(arg);
+    }
+  }
+
+  for (const Benchmark& b : BENCHMARKS)
+  {
+    if (selected.empty() || find(selected.begin(), selected.end(), b.name) != selected.end())
+    {
+      b.run(n);
+      cout << endl;
+    }
+  }
+  return 0;
+}
@@ -1,10 +1,39 @@
 #include <iostream>
 #include <map>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "slabavl.h"
+#include "avlset.h"
+#include "smallavl.h"
+#include "chunkedavl.h"
+#include "flatmap.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "snapshot.h"
+#include "sharedavl.h"
+#include "pagedbtree.h"
+#include "merkleavl.h"
+#include "indexedavl.h"
+#include "lsmstore.h"
+#include "wal.h"
 
 using namespace std;
 
+static void removeDir(const string& dir)
+{
+  DIR* listing = opendir(dir.c_str());
+  if (listing == NULL)
+    return;
+  while (struct dirent* entry = readdir(listing))
+  {
+    string name = entry->d_name;
+    if (name != "." && name != "..")
+      unlink((dir + "/" + name).c_str());
+  }
+  closedir(listing);
+  rmdir(dir.c_str());
+}
 
 int main(int argc, char *argv[])
 {
@@ -44,6 +73,401 @@ int main(int argc, char *argv[])
     }
     cout << "Erasing b" << endl;
     at.remove('b');
+    vector<char> probes;
+    probes.push_back('a');
+    probes.push_back('b');
+    probes.push_back('c');
+    vector<AVLTree<char,int>::iterator> found;
+    at.findBatch(probes, found);
+    for(size_t i = 0; i < probes.size(); i++) {
+        cout << "findBatch " << probes[i] << ": " << (found[i] != at.end() ? "found" : "not found") << endl;
+    }
+    at.setBloomFilter(true);
+    cout << "With a bloom filter, b is " << (at.find('b') == at.end() ? "not found" : "found")
+         << " (" << at.bloomSkips() << " descents skipped)" << endl;
+    AVLTree<char,int> at2;
+    at2.insert(at.extract('a'));
+    cout << "Moved a: " << (at.find('a') == at.end() ? "gone" : "still present")
+         << ", other tree has a " << at2['a'] << endl;
+
+    // Relaxed AVL Tree Tests
+    AVLTree<int,int> rx;
+    rx.setRelaxed(true);
+    for(int i = 0; i < 100; i++) {
+        rx.insert(std::make_pair(i, i));
+    }
+    cout << "\nRelaxed AVLTree height " << rx.height() << ", "
+         << (rx.isBalanced() ? "balanced" : "not balanced") << endl;
+    rx.rebalance();
+    cout << "After rebalance height " << rx.height() << ", "
+         << (rx.isBalanced() ? "balanced" : "not balanced") << endl;
+
+    // Lazy Removal Tests
+    AVLTree<int,int> lz;
+    lz.setLazyRemove(true, 0.9);
+    for(int i = 1; i <= 6; i++) {
+        lz.insert(std::make_pair(i, i));
+    }
+    lz.remove(2);
+    lz.remove(4);
+    lz.remove(5);
+    lz.insert(std::make_pair(4, 40));
+    cout << "\nLazy AVLTree (" << lz.size() << " live, " << lz.tombstoneCount() << " tombstones):";
+    for(AVLTree<int,int>::iterator it = lz.begin(); it != lz.end(); ++it) {
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl << "2 is " << (lz.find(2) == lz.end() ? "gone" : "present");
+    lz.compact();
+    cout << ", after compact " << lz.tombstoneCount() << " tombstones, "
+         << (lz.isBalanced() ? "balanced" : "not balanced") << endl;
+
+    // Sorted Lookup Tests
+    AVLTree<int,int> fs;
+    for(int i = 0; i < 20; i += 2) {
+        fs.insert(std::make_pair(i, i * i));
+    }
+    vector<int> sortedProbes;
+    for(int i = -1; i < 22; i += 3) {
+        sortedProbes.push_back(i);
+    }
+    vector<AVLTree<int,int>::iterator> sortedFound(sortedProbes.size());
+    fs.findSorted(sortedProbes.begin(), sortedProbes.end(), sortedFound.begin());
+    size_t sortedHits = 0;
+    bool sortedAgrees = true;
+    for(size_t i = 0; i < sortedProbes.size(); i++) {
+        sortedHits += (sortedFound[i] != fs.end());
+        sortedAgrees = sortedAgrees && (sortedFound[i] == fs.find(sortedProbes[i]));
+    }
+    cout << "\nfindSorted: " << sortedHits << " of " << sortedProbes.size() << " keys found, "
+         << (sortedAgrees ? "matches" : "DIFFERS from") << " find" << endl;
+
+    // Erase While Iterating Tests
+    AVLTree<int,int> er;
+    for(int i = 0; i < 10; i++) {
+        er.insert(std::make_pair(i, i));
+    }
+    for(AVLTree<int,int>::iterator it = er.begin(); it != er.end(); ) {
+        if(it->first % 3 == 0) {
+            it = er.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    cout << "\nAfter erasing multiples of 3 (" << (er.isBalanced() ? "balanced" : "not balanced") << "):";
+    for(AVLTree<int,int>::iterator it = er.begin(); it != er.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Copy and Move Tests
+    AVLTree<int,int> src;
+    for(int i = 0; i < 5; i++) {
+        src.insert(std::make_pair(i, i));
+    }
+    AVLTree<int,int> cp(src);
+    cp.insert(std::make_pair(0, 100));
+    cp.remove(4);
+    AVLTree<int,int>& cpSelf = cp;
+    cp = cpSelf;
+    cout << "\nSource 0 is " << src[0] << " with " << src.size() << " keys, copy 0 is "
+         << cp[0] << " with " << cp.size() << " keys" << endl;
+    AVLTree<int,int> mv(std::move(src));
+    cout << "Moved " << mv.size() << " keys, source is " << (src.empty() ? "empty" : "NOT empty") << endl;
+    BinarySearchTree<int,int> bcp;
+    bcp.insert(std::make_pair(1, 1));
+    BinarySearchTree<int,int> bmv;
+    bmv = std::move(bcp);
+    bcp = bmv;
+    bcp.insert(std::make_pair(2, 2));
+    cout << "BinarySearchTree copy has 2: " << (bcp.find(2) != bcp.end() ? "yes" : "no")
+         << ", source has 2: " << (bmv.find(2) != bmv.end() ? "yes" : "no") << endl;
+
+    // Defragment Tests
+    AVLTree<int,int> df;
+    df.setLazyRemove(true, 0.9);
+    for(int i = 0; i < 64; i++) {
+        df.insert(std::make_pair((i * 37) % 64, i));
+    }
+    df.remove(0);
+    df.remove(1);
+    df.remove(40);
+    df.defragment();
+    cout << "\nDefragmented AVLTree nodes are "
+         << (df.meanSuccessorDistance() == sizeof(AVLNode<int,int>) ? "contiguous" : "NOT contiguous")
+         << ", " << df.size() << " keys from " << df.begin()->first << endl;
+
+    // Slab-backed AVL Tree Tests
+    SlabAVLTree<char,int> st;
+    st.insert(std::make_pair('a',1));
+    st.insert(std::make_pair('b',2));
+
+    cout << "\nSlabAVLTree contents:" << endl;
+    for(SlabAVLTree<char,int>::iterator it = st.begin(); it != st.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Erasing b" << endl;
+    st.remove('b');
+    cout << "b " << (st.find('b') != st.end() ? "still present" : "removed") << endl;
+
+    // AVL Set Tests
+    AVLSet<char> as;
+    as.insert('a');
+    as.insert('b');
+    as.insert('a');
+
+    cout << "\nAVLSet contents:" << endl;
+    for(AVLSet<char>::iterator it = as.begin(); it != as.end(); ++it) {
+        cout << *it << endl;
+    }
+    cout << "Erasing b" << endl;
+    as.erase('b');
+    cout << "b " << (as.contains('b') ? "still present" : "removed") << endl;
+
+    // Small AVL Tree Tests
+    SmallAVLTree<char,int,2> sm;
+    sm.insert(std::make_pair('b',2));
+    sm.insert(std::make_pair('a',1));
+    cout << "\nSmallAVLTree " << (sm.isInline() ? "inline" : "promoted") << endl;
+    sm.insert(std::make_pair('c',3));
+    cout << "SmallAVLTree " << (sm.isInline() ? "inline" : "promoted") << " contents:" << endl;
+    for(SmallAVLTree<char,int,2>::iterator it = sm.begin(); it != sm.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    std::vector<SmallAVLTree<char,int,2> > smalls(3);
+    smalls[0].insert(std::make_pair('x',24));
+    smalls[1] = sm;
+    smalls[1].remove('a');
+    smalls.push_back(std::move(smalls[1]));
+    SmallAVLTree<char,int,2> smCopy(smalls[0]);
+    smCopy.insert(std::make_pair('y',25));
+    cout << "SmallAVLTree copies and moves:";
+    for(size_t i = 0; i < smalls.size(); i++) {
+        cout << " [" << (smalls[i].isInline() ? "inline" : "promoted");
+        for(SmallAVLTree<char,int,2>::iterator it = smalls[i].begin(); it != smalls[i].end(); ++it) {
+            cout << " " << it->first;
+        }
+        cout << "]";
+    }
+    cout << ", original has " << (sm.find('a') != sm.end() ? "a" : "no a")
+         << ", copy of the first has " << (smCopy.find('y') != smCopy.end() ? "y" : "no y")
+         << " and the first " << (smalls[0].find('y') != smalls[0].end() ? "y" : "no y") << endl;
+
+    // Chunked AVL Tree Tests
+    ChunkedAVLTree<int,int,4> ct;
+    for(int i = 0; i < 20; i++) {
+        ct.insert(std::make_pair((i * 7) % 20, i));
+    }
+    cout << "\nChunkedAVLTree has " << ct.chunkCount() << " chunks after 20 inserts" << endl;
+    for(int i = 0; i < 20; i += 3) {
+        ct.remove(i);
+        ct.remove(i + 1);
+    }
+    cout << "ChunkedAVLTree has " << ct.chunkCount() << " chunks after removals, contents:";
+    for(ChunkedAVLTree<int,int,4>::iterator it = ct.begin(); it != ct.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Flat Map Tests
+    FlatMap<char,int> fm;
+    fm.insert(std::make_pair('c',3));
+    vector<std::pair<const char,int> > batch;
+    batch.push_back(std::make_pair('e',5));
+    batch.push_back(std::make_pair('a',1));
+    batch.push_back(std::make_pair('c',30));
+    batch.push_back(std::make_pair('a',10));
+    fm.insert(batch.begin(), batch.end());
+    fm.remove('e');
+    cout << "\nFlatMap contents:" << endl;
+    for(FlatMap<char,int>::iterator it = fm.begin(); it != fm.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // Red-Black Tree Tests
+    RBTree<char,int> rt;
+    rt.insert(std::make_pair('a',1));
+    rt.insert(std::make_pair('b',2));
+    rt.insert(std::make_pair('c',3));
+
+    cout << "\nRBTree contents:" << endl;
+    for(RBTree<char,int>::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Erasing b" << endl;
+    rt.remove('b');
+    cout << "RBTree is " << (rt.isValidRB() ? "valid" : "INVALID") << endl;
+
+    // Splay Tree Tests
+    SplayTree<char,int> spt;
+    spt.insert(std::make_pair('a',1));
+    spt.insert(std::make_pair('b',2));
+    spt.insert(std::make_pair('c',3));
+    if(spt.find('a') != spt.end()) {
+        cout << "\nFound a in SplayTree, now at the root:" << endl;
+    }
+    spt.print();
+    cout << "Erasing b" << endl;
+    spt.remove('b');
+    for(SplayTree<char,int>::iterator it = spt.begin(); it != spt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // Snapshot Tests
+    MappedSnapshot<char,int>::save(rt, "bst-test.snap");
+    MappedSnapshot<char,int> snap;
+    snap.load("bst-test.snap");
+    cout << "\nSnapshot of RBTree (" << (snap.verify() ? "checksum ok" : "BAD checksum") << "):" << endl;
+    for(MappedSnapshot<char,int>::iterator it = snap.begin(); it != snap.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Snapshot c is " << snap['c'] << endl;
+    snap.close();
+    unlink("bst-test.snap");
+
+    // Shared Tree Tests
+    SharedAVLTree<char,int> sw;
+    sw.create("bst-test.shm", 16);
+    sw.insert(std::make_pair('a',1));
+    sw.insert(std::make_pair('b',2));
+    sw.insert(std::make_pair('c',3));
+    sw.remove('b');
+    SharedAVLTree<char,int> sr;
+    sr.attach("bst-test.shm");
+    int sv = 0;
+    cout << "\nSharedAVLTree reader (version " << sr.version() << "): a "
+         << (sr.lookup('a', sv) ? "found" : "missing") << " " << sv << ", b "
+         << (sr.lookup('b', sv) ? "found" : "missing") << endl;
+    sw.close();
+    SharedAVLTree<char,int> sw2;
+    sw2.openWriter("bst-test.shm");
+    sw2.insert(std::make_pair('d',4));
+    cout << "Reopened SharedAVLTree writer holds " << sw2.size() << " keys, reader sees d "
+         << (sr.lookup('d', sv) ? "found" : "missing") << " " << sv << endl;
+    unlink("bst-test.shm");
+
+    // Paged Tree Tests
+    unlink("bst-test.btree");
+    {
+        PagedBTree<char,int> pt("bst-test.btree", 0, 256);
+        for(char c = 'a'; c <= 'z'; c++) {
+            pt.insert(std::make_pair(c, c - 'a'));
+        }
+        pt.remove('m');
+    }
+    PagedBTree<char,int> pt("bst-test.btree", 0, 256);
+    cout << "\nReopened PagedBTree with " << pt.size() << " keys, q is " << pt['q'] << ":" << endl;
+    for(PagedBTree<char,int>::iterator it = pt.lowerBound('k'); it != pt.end() && it->first < 'p'; ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    unlink("bst-test.btree");
+
+    // Merkle Tree Tests
+    MerkleAVLTree<char,int> ma, mb;
+    for(char c = 'a'; c <= 'h'; c++) {
+        ma.insert(std::make_pair(c, c - 'a'));
+        mb.insert(std::make_pair('a' + 'h' - c, 'h' - c));
+    }
+    cout << "\nMerkleAVLTree digests " << (ma.digest() == mb.digest() ? "match" : "differ") << endl;
+    std::vector<std::pair<char,int> > sortedItems;
+    for(char c = 'a'; c <= 'h'; c++) {
+        sortedItems.push_back(std::make_pair(c, c - 'a'));
+    }
+    MerkleAVLTree<char,int> mc;
+    mc.insertSorted(sortedItems.begin(), sortedItems.end());
+    mc.defragment();
+    cout << "Bulk-loaded and defragmented MerkleAVLTree digest "
+         << (mc.digest() == ma.digest() ? "matches" : "differs") << endl;
+    mb.insert(std::make_pair('c', 30));
+    mb.remove('f');
+    std::vector<char> changed = diff(ma, mb);
+    cout << "Keys that differ:";
+    for(size_t i = 0; i < changed.size(); i++) {
+        cout << " " << changed[i];
+    }
+    cout << endl;
+
+    // Indexed Map Tests
+    IndexedAVLMap<char,int> im;
+    for(char c = 'a'; c <= 'j'; c++) {
+        im.insert(std::make_pair(c, c - 'a'));
+    }
+    im.remove('e');
+    cout << "\nIndexedAVLMap g is " << im['g'] << ", e is "
+         << (im.find('e') == im.end() ? "gone" : "present") << ", from d:";
+    for(IndexedAVLMap<char,int>::iterator it = im.lowerBound('d'); it != im.end() && it->first < 'h'; ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+    IndexedAVLMap<char,int> imMoved(std::move(im));
+    im.insert(std::make_pair('z', 25));
+    cout << "Moved-from IndexedAVLMap holds " << im.size() << " entry, z is " << im['z']
+         << "; the moved-to map holds " << imMoved.size() << endl;
+
+    // LSM Store Tests
+    removeDir("bst-test.lsm");
+    {
+        LSMStore<int,int> ls("bst-test.lsm", 4, 3);
+        for(int i = 0; i < 20; i++) {
+            ls.insert(std::make_pair(i, i * i));
+        }
+        ls.remove(3);
+        ls.remove(17);
+        ls.insert(std::make_pair(5, -5));
+        ls.flush();
+        ls.waitForCompaction();
+        cout << "\nLSMStore has " << ls.runCount() << " runs and "
+             << ls.memtableSize() << " keys in the memtable" << endl;
+    }
+    {
+        LSMStore<int,int> ls("bst-test.lsm", 4, 3);
+        cout << "Reopened LSMStore:";
+        for(int i = 0; i < 20; i++) {
+            int value;
+            if(ls.lookup(i, value)) {
+                cout << " " << i << "=" << value;
+            }
+        }
+        cout << endl;
+    }
+    removeDir("bst-test.lsm");
+
+    // Write-Ahead Log Tests
+    removeDir("bst-test.wal");
+    {
+        LoggedAVLTree<char,int> lt("bst-test.wal");
+        for(char c = 'a'; c <= 'f'; c++) {
+            lt.insert(std::make_pair(c, c - 'a'));
+        }
+        lt.remove('c');
+        lt.insert(std::make_pair('a', 10));
+    }
+    {
+        LoggedAVLTree<char,int> lt("bst-test.wal");
+        cout << "\nLoggedAVLTree replayed " << lt.replayedRecords() << " records:";
+        for(char c = 'a'; c <= 'f'; c++) {
+            int value;
+            if(lt.lookup(c, value)) {
+                cout << " " << c << "=" << value;
+            }
+        }
+        cout << endl;
+        lt.checkpoint();
+        lt.insert(std::make_pair('z', 25));
+        lt.remove('b');
+    }
+    {
+        LoggedAVLTree<char,int> lt("bst-test.wal");
+        cout << "After a checkpoint, replayed " << lt.replayedRecords() << " records:";
+        for(char c = 'a'; c <= 'z'; c++) {
+            int value;
+            if(lt.lookup(c, value)) {
+                cout << " " << c << "=" << value;
+            }
+        }
+        cout << endl;
+    }
+    removeDir("bst-test.wal");
 
     return 0;
 }
@@ -4,7 +4,20 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cstdint>
 #include <utility>
+#include <vector>
+#include <algorithm>
+
+/**
+ * The item stored in each Node. Specialized by containers that do not
+ * store a full key/value pair (see AVLSet).
+ */
+template <typename Key, typename Value>
+struct NodeItem
+{
+    typedef std::pair<const Key, Value> type;
+};
 
 /**
  * A templated class for a Node in a search tree.
@@ -17,11 +30,14 @@ template <typename Key, typename Value>
 class Node
 {
 public:
+    typedef typename NodeItem<Key, Value>::type item_type;
+
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
     virtual ~Node();
+    virtual Node<Key, Value>* clone() const;
 
-    const std::pair<const Key, Value>& getItem() const;
-    std::pair<const Key, Value>& getItem();
+    const item_type& getItem() const;
+    item_type& getItem();
     const Key& getKey() const;
     const Value& getValue() const;
     Value& getValue();
@@ -35,8 +51,21 @@ public:
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
 
+    bool isTombstone() const;
+    void setTombstone(bool tombstone);
+
 protected:
-    std::pair<const Key, Value> item_;
+    // Nodes are at least 8-byte aligned (they carry a vtable pointer), so the
+    // low bits of parent_ are free. Derived nodes may stash small per-node
+    // state there; getParent()/setParent() always mask it off/preserve it.
+    // The low bit of left_ likewise holds the tombstone flag.
+    static const uintptr_t TAG_MASK = 0x7;
+    static const uintptr_t TOMBSTONE_BIT = 0x1;
+    uintptr_t getTag() const;
+    void setTag(uintptr_t tag);
+    void copyStateFrom(const Node<Key, Value>& other);
+
+    item_type item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
@@ -72,11 +101,24 @@ Node<Key, Value>::~Node()
 
 }
 
+/**
+* Returns a new, unlinked node of the same kind, with a copy of the item
+* and of the per-node state kept in the tag bits and tombstone flag.
+* Overridden by derived nodes so that tree copies keep their node type.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::clone() const
+{
+    Node<Key, Value>* copy = new Node<Key, Value>(getKey(), getValue(), nullptr);
+    copy->copyStateFrom(*this);
+    return copy;
+}
+
 /**
 * A const getter for the item.
 */
 template<typename Key, typename Value>
-const std::pair<const Key, Value>& Node<Key, Value>::getItem() const
+const typename Node<Key, Value>::item_type& Node<Key, Value>::getItem() const
 {
     return item_;
 }
@@ -85,7 +127,7 @@ const std::pair<const Key, Value>& Node<Key, Value>::getItem() const
 * A non-const getter for the item.
 */
 template<typename Key, typename Value>
-std::pair<const Key, Value>& Node<Key, Value>::getItem()
+typename Node<Key, Value>::item_type& Node<Key, Value>::getItem()
 {
     return item_;
 }
@@ -123,7 +165,8 @@ Value& Node<Key, Value>::getValue()
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
 {
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(
+        reinterpret_cast<uintptr_t>(parent_) & ~TAG_MASK);
 }
 
 /**
@@ -132,7 +175,8 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
 {
-    return left_;
+    return reinterpret_cast<Node<Key, Value>*>(
+        reinterpret_cast<uintptr_t>(left_) & ~TOMBSTONE_BIT);
 }
 
 /**
@@ -150,7 +194,57 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    parent_ = reinterpret_cast<Node<Key, Value>*>(
+        reinterpret_cast<uintptr_t>(parent) | getTag());
+}
+
+/**
+* Returns true if the node is a tombstone: still linked in, but its entry
+* has been removed (see AVLTree::setLazyRemove).
+*/
+template<typename Key, typename Value>
+bool Node<Key, Value>::isTombstone() const
+{
+    return (reinterpret_cast<uintptr_t>(left_) & TOMBSTONE_BIT) != 0;
+}
+
+/**
+* A setter for the tombstone flag stored alongside the left pointer.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setTombstone(bool tombstone)
+{
+    left_ = reinterpret_cast<Node<Key, Value>*>(
+        (reinterpret_cast<uintptr_t>(left_) & ~TOMBSTONE_BIT) | (tombstone ? TOMBSTONE_BIT : 0));
+}
+
+/**
+* A getter for the tag bits stored alongside the parent pointer.
+*/
+template<typename Key, typename Value>
+uintptr_t Node<Key, Value>::getTag() const
+{
+    return reinterpret_cast<uintptr_t>(parent_) & TAG_MASK;
+}
+
+/**
+* A setter for the tag bits stored alongside the parent pointer.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setTag(uintptr_t tag)
+{
+    parent_ = reinterpret_cast<Node<Key, Value>*>(
+        (reinterpret_cast<uintptr_t>(parent_) & ~TAG_MASK) | (tag & TAG_MASK));
+}
+
+/**
+* Copies the tag bits and the tombstone flag, but not the links.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::copyStateFrom(const Node<Key, Value>& other)
+{
+    setTag(other.getTag());
+    setTombstone(other.isTombstone());
 }
 
 /**
@@ -159,7 +253,8 @@ void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 template<typename Key, typename Value>
 void Node<Key, Value>::setLeft(Node<Key, Value>* left)
 {
-    left_ = left;
+    left_ = reinterpret_cast<Node<Key, Value>*>(
+        reinterpret_cast<uintptr_t>(left) | (isTombstone() ? TOMBSTONE_BIT : 0));
 }
 
 /**
@@ -194,11 +289,17 @@ class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree<Key, Value>& other);
+    BinarySearchTree(BinarySearchTree<Key, Value>&& other) noexcept;
     virtual ~BinarySearchTree(); //TODO
+    BinarySearchTree<Key, Value>& operator=(const BinarySearchTree<Key, Value>& other);
+    BinarySearchTree<Key, Value>& operator=(BinarySearchTree<Key, Value>&& other) noexcept;
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    int height() const;
+    double meanSuccessorDistance() const;
     void print() const;
     bool empty() const;
 
@@ -213,8 +314,8 @@ public:
     public:
         iterator();
 
-        std::pair<const Key,Value>& operator*() const;
-        std::pair<const Key,Value>* operator->() const;
+        typename Node<Key, Value>::item_type& operator*() const;
+        typename Node<Key, Value>::item_type* operator->() const;
 
         bool operator==(const iterator& rhs) const;
         bool operator!=(const iterator& rhs) const;
@@ -231,10 +332,16 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    void findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    template<typename RandomIt, typename OutputIt>
+    OutputIt findSorted(RandomIt first, RandomIt last, OutputIt out) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
+    // number of lookups findBatch keeps in flight
+    static const size_t FIND_BATCH_WIDTH = 16;
+
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
@@ -249,9 +356,18 @@ protected:
     // Add helper functions here
     static Node<Key, Value>* successor(Node<Key, Value>* current);
     virtual void destroyHelper(Node<Key, Value>* currNode);
+    static Node<Key, Value>* cloneHelper(const Node<Key, Value>* currNode, Node<Key, Value>* parent);
     virtual void removeHelp(Node<Key, Value>* currNode);
+    void unlinkNode(Node<Key, Value>* currNode);
+    static Node<Key, Value>* iteratorNode(const iterator& it);
+    static iterator iteratorAt(Node<Key, Value>* node);
     Node<Key, Value>* finderHelper(Node<Key, Value>* currNode, const Key& k) const;
+    template<typename RandomIt, typename OutputIt>
+    OutputIt findSortedHelper(Node<Key, Value>* currNode, RandomIt first, RandomIt last, OutputIt out) const;
     int balancedHelper(Node<Key, Value>* currNode) const;
+    static int heightHelper(Node<Key, Value>* currNode);
+    void rotateLeft(Node<Key, Value>* head);
+    void rotateRight(Node<Key, Value>* head);
 
 protected:
     Node<Key, Value>* root_;
@@ -288,7 +404,7 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 * Provides access to the item.
 */
 template<class Key, class Value>
-std::pair<const Key,Value> &
+typename Node<Key, Value>::item_type &
 BinarySearchTree<Key, Value>::iterator::operator*() const
 {
     return current_->getItem();
@@ -298,7 +414,7 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 * Provides access to the address of the item.
 */
 template<class Key, class Value>
-std::pair<const Key,Value> *
+typename Node<Key, Value>::item_type *
 BinarySearchTree<Key, Value>::iterator::operator->() const
 {
     return &(current_->getItem());
@@ -333,14 +449,17 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 
 
 /**
-* Advances the iterator's location using an in-order sequencing
+* Advances the iterator's location using an in-order sequencing, skipping tombstones
 */
 template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator&
 BinarySearchTree<Key, Value>::iterator::operator++()
 {
      //TODO
-  current_ = successor(current_);
+  do
+  {
+    current_ = successor(current_);
+  } while (current_ != nullptr && current_->isTombstone());
   return *this;
 } 
 
@@ -367,6 +486,27 @@ BinarySearchTree<Key, Value>::BinarySearchTree()
   root_ = nullptr;
 }
 
+/**
+* Copies other's structure as is, in O(n): every node is cloned in one
+* pre-order pass with its links and per-node state, so nothing is
+* re-inserted or rebalanced.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree<Key, Value>& other)
+{
+  root_ = cloneHelper(other.root_, nullptr);
+}
+
+/**
+* Takes other's nodes in O(1), leaving it empty.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(BinarySearchTree<Key, Value>&& other) noexcept
+{
+  root_ = other.root_;
+  other.root_ = nullptr;
+}
+
 template<typename Key, typename Value>
 BinarySearchTree<Key, Value>::~BinarySearchTree()
 {
@@ -374,6 +514,36 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
   clear();
 }
 
+/**
+* Replaces the contents with a structural copy of other's.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(const BinarySearchTree<Key, Value>& other)
+{
+  if (this != &other)
+  {
+    Node<Key, Value>* copy = cloneHelper(other.root_, nullptr);
+    BinarySearchTree<Key, Value>::clear();
+    root_ = copy;
+  }
+  return *this;
+}
+
+/**
+* Frees the current contents and takes other's nodes, leaving it empty.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(BinarySearchTree<Key, Value>&& other) noexcept
+{
+  if (this != &other)
+  {
+    BinarySearchTree<Key, Value>::clear();
+    root_ = other.root_;
+    other.root_ = nullptr;
+  }
+  return *this;
+}
+
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::destroyHelper(Node<Key, Value>* currNode)
 {
@@ -385,6 +555,50 @@ void BinarySearchTree<Key, Value>::destroyHelper(Node<Key, Value>* currNode)
   return;
 }
 
+/**
+* Returns a copy of the subtree at currNode, hung from parent. Nodes are
+* allocated in pre-order, so a fresh heap lays each one out just before
+* its left subtree.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::cloneHelper(const Node<Key, Value>* currNode, Node<Key, Value>* parent)
+{
+  if (currNode == nullptr)
+    return nullptr;
+  Node<Key, Value>* copy = currNode->clone();
+  copy->setParent(parent);
+  copy->setLeft(cloneHelper(currNode->getLeft(), copy));
+  copy->setRight(cloneHelper(currNode->getRight(), copy));
+  return copy;
+}
+
+/**
+* Returns the mean distance in bytes between the addresses of in-order
+* neighbours (tombstones included). It approaches the allocation size of
+* a node when an in-order scan walks memory sequentially, and grows as
+* churn scatters the nodes across the heap.
+*/
+template<typename Key, typename Value>
+double BinarySearchTree<Key, Value>::meanSuccessorDistance() const
+{
+  Node<Key, Value>* prevNode = getSmallestNode();
+  if (prevNode == nullptr)
+  {
+    return 0;
+  }
+  double total = 0;
+  size_t count = 0;
+  for (Node<Key, Value>* currNode = successor(prevNode); currNode != nullptr; currNode = successor(currNode))
+  {
+    uintptr_t a = reinterpret_cast<uintptr_t>(prevNode);
+    uintptr_t b = reinterpret_cast<uintptr_t>(currNode);
+    total += (a < b) ? b - a : a - b;
+    count++;
+    prevNode = currNode;
+  }
+  return count == 0 ? 0 : total / count;
+}
+
 /**
  * Returns true if tree is empty
 */
@@ -409,6 +623,10 @@ typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::begin() const
 {
     BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    if (begin.current_ != nullptr && begin.current_->isTombstone())
+    {
+        ++begin;
+    }
     return begin;
 }
 
@@ -436,6 +654,93 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
     return it;
 }
 
+/**
+* Looks up every key, setting out[i] to find(keys[i]). Up to
+* FIND_BATCH_WIDTH lookups walk down the tree together, one level per
+* round, and each prefetches the node it moves to. The next round only
+* reaches that node after the other lookups have taken their steps, so the
+* cache misses of independent lookups overlap instead of being paid one
+* after another. A finished lookup's slot is refilled with the next key.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+  out.assign(keys.size(), end());
+  if (root_ == nullptr)
+  {
+    return;
+  }
+  Node<Key, Value>* curr[FIND_BATCH_WIDTH];
+  size_t index[FIND_BATCH_WIDTH];
+  size_t active = 0;
+  size_t next = 0;
+  while (active < FIND_BATCH_WIDTH && next < keys.size())
+  {
+    curr[active] = root_;
+    index[active++] = next++;
+  }
+
+  while (active > 0)
+  {
+    for (size_t i = 0; i < active; )
+    {
+      Node<Key, Value>* currNode = curr[i];
+      const Key& k = keys[index[i]];
+      if (currNode->getKey() < k)
+      {
+        currNode = currNode->getRight();
+      }
+      else if (currNode->getKey() > k)
+      {
+        currNode = currNode->getLeft();
+      }
+      else
+      {
+        if (!currNode->isTombstone())
+        {
+          out[index[i]] = iterator(currNode);
+        }
+        currNode = nullptr;
+      }
+
+      if (currNode != nullptr)
+      {
+#if defined(__GNUC__)
+        __builtin_prefetch(currNode);
+#endif
+        curr[i++] = currNode;
+      }
+      else if (next < keys.size())
+      {
+        //the root is hot after the first round, no need to prefetch it
+        curr[i] = root_;
+        index[i++] = next++;
+      }
+      else
+      {
+        //retire the slot by moving the last active lookup into it
+        active--;
+        curr[i] = curr[active];
+        index[i] = index[active];
+      }
+    }
+  }
+}
+
+/**
+* Looks up the sorted keys in [first, last), writing find(key) for each to
+* out in order, and returns the end of the output. The keys are split
+* around each node on the way down, so a path shared by several keys is
+* walked once and a subtree holding none of them is never entered. m keys
+* cost about O(m log(n/m)) instead of the O(m log n) of separate finds.
+*/
+template<class Key, class Value>
+template<typename RandomIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value>::findSorted(RandomIt first, RandomIt last, OutputIt out) const
+{
+  return findSortedHelper(root_, first, last, out);
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -504,7 +809,7 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 
 /**
 Returns the node in currNode's subtree which contains Key k
-Returns nullptr if not found
+Returns nullptr if not found (or only present as a tombstone)
 **/
 template<typename Key, typename Value>
 Node<Key, Value>* BinarySearchTree<Key, Value>::finderHelper(Node<Key, Value>* currNode, const Key& k) const
@@ -521,13 +826,63 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::finderHelper(Node<Key, Value>* c
   {
     return finderHelper(currNode->getLeft(), k);
   }
+  if (currNode->isTombstone())
+  {
+    return nullptr;
+  }
   return currNode;
 }
 
+/**
+* Resolves the sorted keys in [first, last), all of which fall inside
+* currNode's subtree range: those below its key go left, those equal to it
+* are found here and the rest go right.
+*/
+template<typename Key, typename Value>
+template<typename RandomIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value>::findSortedHelper(Node<Key, Value>* currNode, RandomIt first, RandomIt last, OutputIt out) const
+{
+  if (currNode == nullptr)
+  {
+    for (; first != last; ++first)
+    {
+      *out++ = end();
+    }
+    return out;
+  }
+  if (first == last)
+  {
+    return out;
+  }
+  RandomIt mid = std::lower_bound(first, last, currNode->getKey());
+  out = findSortedHelper(currNode->getLeft(), first, mid, out);
+  iterator found(currNode->isTombstone() ? nullptr : currNode);
+  for (; mid != last && !(currNode->getKey() < *mid); ++mid)
+  {
+    *out++ = found;
+  }
+  return findSortedHelper(currNode->getRight(), mid, last, out);
+}
+
 
 
 template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::removeHelp(Node<Key, Value>* currNode)
+{
+  if (currNode == nullptr)
+  {
+    return;
+  }
+  unlinkNode(currNode);
+  delete currNode;
+}
+
+/**
+* Unlinks currNode from the tree without freeing it. A node with two
+* children is first swapped with its predecessor.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::unlinkNode(Node<Key, Value>* currNode)
 {
   if (currNode == nullptr)
   {
@@ -559,7 +914,7 @@ void BinarySearchTree<Key, Value>::removeHelp(Node<Key, Value>* currNode)
     nodeSwap(currNode, pred);
     //currNode and pred pointers update
 
-    removeHelp(currNode);
+    unlinkNode(currNode);
     return;
   }
   else
@@ -602,10 +957,27 @@ void BinarySearchTree<Key, Value>::removeHelp(Node<Key, Value>* currNode)
       root_ = child;
     }
   }
-  delete currNode;
   return;
 }
 
+/**
+* Returns the node an iterator points at (nullptr for end()).
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::iteratorNode(const iterator& it)
+{
+  return it.current_;
+}
+
+/**
+* Returns an iterator to node, which must be live or nullptr.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* node)
+{
+  return iterator(node);
+}
+
 /**
 * A remove method to remove a specific key from a Binary Search Tree.
 * Recall: The writeup specifies that if a node has 2 children you
@@ -790,6 +1162,26 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
   return ( balancedHelper(root_) != -1 );
 }
 
+/**
+ * Returns the number of nodes on the longest root-to-leaf path, 0 for an
+ * empty tree.
+ */
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::height() const
+{
+  return heightHelper(root_);
+}
+
+template<typename Key, typename Value>
+int BinarySearchTree<Key, Value>::heightHelper(Node<Key, Value>* currNode)
+{
+  if (currNode == nullptr)
+  {
+    return 0;
+  }
+  return 1 + std::max(heightHelper(currNode->getLeft()), heightHelper(currNode->getRight()));
+}
+
 
 
 template<typename Key, typename Value>
@@ -876,6 +1268,58 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 }
 
+/**
+* Rotates head's right child up into head's place; head becomes its left child.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::rotateLeft(Node<Key, Value>* head)
+{
+  Node<Key, Value>* left = head;
+  Node<Key, Value>* top = head->getRight();
+
+  left->setRight(top->getLeft());
+  if (left->getRight() != nullptr)
+    left->getRight()->setParent(left);
+  top->setParent(left->getParent());
+  if (top->getParent() != nullptr)
+  {
+    if (top->getParent()->getLeft() == left)
+      top->getParent()->setLeft(top);
+    else
+      top->getParent()->setRight(top);
+  }
+  else
+    root_ = top;
+  top->setLeft(left);
+  left->setParent(top);
+}
+
+/**
+* Rotates head's left child up into head's place; head becomes its right child.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::rotateRight(Node<Key, Value>* head)
+{
+  Node<Key, Value>* right = head;
+  Node<Key, Value>* top = head->getLeft();
+
+  right->setLeft(top->getRight());
+  if (right->getLeft() != nullptr)
+    right->getLeft()->setParent(right);
+  top->setParent(right->getParent());
+  if (top->getParent() != nullptr)
+  {
+    if (top->getParent()->getLeft() == right)
+      top->getParent()->setLeft(top);
+    else
+      top->getParent()->setRight(top);
+  }
+  else
+    root_ = top;
+  top->setRight(right);
+  right->setParent(top);
+}
+
 /**
  * Lastly, we are providing you with a print function,
    BinarySearchTree::printRoot().
@@ -0,0 +1,549 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+* A fixed number of in-memory frames caching fixed-size pages of one file.
+* fetch() pins a page into a frame, reading it if needed; when no frame
+* is free, the CLOCK hand picks an unpinned frame whose page has not been
+* used since the hand last passed, writing it back first if dirty.
+*
+* Every frame carries a reader/writer latch for its page. Latches and pins
+* are held through PageRef, which releases both when it goes away. When
+* every frame is pinned, fetch() and allocate() wait until a page is
+* unpinned. That wait deadlocks if the waiting threads between them hold
+* every frame, which callers that pin one page while fetching another can
+* easily do. Such a caller first takes an Admission for the most pages it
+* will hold at once; admissions are only granted while their pins fit in
+* the frames, so an admitted fetch always finds a frame to claim.
+*
+* The page table and the CLOCK hand are guarded by one mutex, which is
+* held across the read or write of a page that is faulted in or evicted.
+*/
+class BufferPool
+{
+protected:
+    struct Frame
+    {
+        uint32_t pageId;
+        int pins;
+        bool valid;
+        bool referenced;
+        bool dirty;
+        pthread_rwlock_t latch;
+        char* data;
+    };
+
+public:
+    /**
+    * A pinned page, optionally latched. Move-only; unlatches and unpins
+    * on destruction or release().
+    */
+    class PageRef
+    {
+    public:
+        PageRef();
+        PageRef(PageRef&& other);
+        PageRef& operator=(PageRef&& other);
+        ~PageRef();
+        PageRef(const PageRef&) = delete;
+        PageRef& operator=(const PageRef&) = delete;
+
+        bool valid() const;
+        uint32_t id() const;
+        char* data() const;
+        void latchShared();
+        void latchExclusive();
+        void markDirty();
+        void release();
+
+    protected:
+        friend class BufferPool;
+        PageRef(BufferPool* pool, Frame* frame);
+
+        BufferPool* pool_;
+        Frame* frame_;
+        int latch_;     // 0 none, 1 shared, 2 exclusive
+        bool dirty_;
+    };
+
+    /**
+    * Reserves frames for a caller that will hold up to pins pages at
+    * once, waiting until they fit beside the reservations already held.
+    * Releases them on destruction. A thread must not take a second one
+    * while holding one.
+    */
+    class Admission
+    {
+    public:
+        Admission(BufferPool& pool, size_t pins);
+        ~Admission();
+        Admission(const Admission&) = delete;
+        Admission& operator=(const Admission&) = delete;
+
+    protected:
+        BufferPool& pool_;
+        size_t pins_;
+    };
+
+    BufferPool(const std::string& path, size_t pageSize, size_t frameCount);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    PageRef fetch(uint32_t pageId);
+    PageRef allocate();
+    void flushAll();
+    void truncate();
+
+    size_t pageSize() const;
+    size_t frameCount() const;
+    uint32_t pageCount() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+    uint64_t writes() const;
+
+protected:
+    Frame* claimFrame(uint32_t pageId);
+    void writeFrame(Frame* frame);
+    void unpin(Frame* frame, bool dirty);
+
+    std::string path_;
+    int fd_;
+    size_t pageSize_;
+    size_t frameCount_;
+    char* memory_;
+    std::unique_ptr<Frame[]> frames_;
+    std::unordered_map<uint32_t, Frame*> table_;
+    size_t hand_;
+    uint32_t pageCount_;
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t writes_;
+    size_t admitted_;   // pins reserved by admissions
+    mutable std::mutex mutex_;
+    std::condition_variable unpinned_;  // a frame's pin count dropped to 0
+    std::condition_variable dismissed_; // an admission ended
+};
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the BufferPool::PageRef class.
+  --------------------------------------------------------
+*/
+
+inline BufferPool::PageRef::PageRef() :
+    pool_(nullptr), frame_(nullptr), latch_(0), dirty_(false)
+{
+
+}
+
+inline BufferPool::PageRef::PageRef(BufferPool* pool, Frame* frame) :
+    pool_(pool), frame_(frame), latch_(0), dirty_(false)
+{
+
+}
+
+inline BufferPool::PageRef::PageRef(PageRef&& other) :
+    pool_(other.pool_), frame_(other.frame_), latch_(other.latch_), dirty_(other.dirty_)
+{
+  other.frame_ = nullptr;
+  other.latch_ = 0;
+  other.dirty_ = false;
+}
+
+/**
+* Releases the page held now, then takes over other's.
+*/
+inline BufferPool::PageRef& BufferPool::PageRef::operator=(PageRef&& other)
+{
+  if (this != &other)
+  {
+    release();
+    pool_ = other.pool_;
+    frame_ = other.frame_;
+    latch_ = other.latch_;
+    dirty_ = other.dirty_;
+    other.frame_ = nullptr;
+    other.latch_ = 0;
+    other.dirty_ = false;
+  }
+  return *this;
+}
+
+inline BufferPool::PageRef::~PageRef()
+{
+  release();
+}
+
+inline bool BufferPool::PageRef::valid() const
+{
+  return frame_ != nullptr;
+}
+
+inline uint32_t BufferPool::PageRef::id() const
+{
+  return frame_->pageId;
+}
+
+inline char* BufferPool::PageRef::data() const
+{
+  return frame_->data;
+}
+
+inline void BufferPool::PageRef::latchShared()
+{
+  pthread_rwlock_rdlock(&frame_->latch);
+  latch_ = 1;
+}
+
+inline void BufferPool::PageRef::latchExclusive()
+{
+  pthread_rwlock_wrlock(&frame_->latch);
+  latch_ = 2;
+}
+
+/**
+* Records that the page was changed, so that it is written back before
+* its frame is reused.
+*/
+inline void BufferPool::PageRef::markDirty()
+{
+  dirty_ = true;
+}
+
+/**
+* Unlatches and unpins the page. The reference is empty afterwards.
+*/
+inline void BufferPool::PageRef::release()
+{
+  if (frame_ == nullptr)
+    return;
+  if (latch_ != 0)
+  {
+    pthread_rwlock_unlock(&frame_->latch);
+  }
+  pool_->unpin(frame_, dirty_);
+  frame_ = nullptr;
+  latch_ = 0;
+  dirty_ = false;
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the BufferPool::PageRef class.
+  ------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------------
+  Begin implementations for the BufferPool::Admission class.
+  ----------------------------------------------------------
+*/
+
+/**
+* More pins than there are frames are capped at the frame count, so such
+* a caller waits until it has the pool to itself.
+*/
+inline BufferPool::Admission::Admission(BufferPool& pool, size_t pins) :
+    pool_(pool), pins_(pins < pool.frameCount_ ? pins : pool.frameCount_)
+{
+  std::unique_lock<std::mutex> lock(pool_.mutex_);
+  while (pool_.admitted_ + pins_ > pool_.frameCount_)
+  {
+    pool_.dismissed_.wait(lock);
+  }
+  pool_.admitted_ += pins_;
+}
+
+inline BufferPool::Admission::~Admission()
+{
+  std::lock_guard<std::mutex> lock(pool_.mutex_);
+  pool_.admitted_ -= pins_;
+  pool_.dismissed_.notify_all();
+}
+
+/*
+  --------------------------------------------------------
+  End implementations for the BufferPool::Admission class.
+  --------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BufferPool class.
+  -----------------------------------------------
+*/
+
+/**
+* Opens (or creates) the page file at path with frameCount frames of
+* pageSize bytes. Throws std::runtime_error if the file cannot be opened.
+*/
+inline BufferPool::BufferPool(const std::string& path, size_t pageSize, size_t frameCount) :
+    path_(path), fd_(-1), pageSize_(pageSize), frameCount_(frameCount == 0 ? 1 : frameCount),
+    memory_(nullptr), frames_(new Frame[frameCount == 0 ? 1 : frameCount]), hand_(0),
+    pageCount_(0), hits_(0), misses_(0), writes_(0), admitted_(0)
+{
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error("cannot open " + path_);
+  }
+  struct stat st;
+  if (::fstat(fd_, &st) != 0 || posix_memalign(reinterpret_cast<void**>(&memory_), 4096, pageSize_ * frameCount_) != 0)
+  {
+    ::close(fd_);
+    throw std::runtime_error("cannot set up a buffer pool for " + path_);
+  }
+  pageCount_ = static_cast<uint32_t>(st.st_size / pageSize_);
+  for (size_t i = 0; i < frameCount_; i++)
+  {
+    Frame& frame = frames_[i];
+    frame.pageId = 0;
+    frame.pins = 0;
+    frame.valid = false;
+    frame.referenced = false;
+    frame.dirty = false;
+    frame.data = memory_ + i * pageSize_;
+    pthread_rwlock_init(&frame.latch, nullptr);
+  }
+}
+
+/**
+* Writes back every dirty page. No page may still be pinned.
+*/
+inline BufferPool::~BufferPool()
+{
+  try
+  {
+    flushAll();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "BufferPool: final flush failed: " << e.what() << std::endl;
+  }
+  for (size_t i = 0; i < frameCount_; i++)
+  {
+    pthread_rwlock_destroy(&frames_[i].latch);
+  }
+  std::free(memory_);
+  ::close(fd_);
+}
+
+/**
+* Pins the page, reading it into a frame if it is not cached and waiting
+* for an unpin if every frame is pinned. The page is returned unlatched.
+*/
+inline BufferPool::PageRef BufferPool::fetch(uint32_t pageId)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  Frame* frame;
+  while (true)
+  {
+    //looked up again after a wait, since another thread may have read the page in
+    std::unordered_map<uint32_t, Frame*>::iterator it = table_.find(pageId);
+    if (it != table_.end())
+    {
+      hits_++;
+      it->second->pins++;
+      it->second->referenced = true;
+      return PageRef(this, it->second);
+    }
+    frame = claimFrame(pageId);
+    if (frame != nullptr)
+    {
+      break;
+    }
+    unpinned_.wait(lock);
+  }
+  misses_++;
+  ssize_t got = ::pread(fd_, frame->data, pageSize_, static_cast<off_t>(pageId) * pageSize_);
+  if (got != static_cast<ssize_t>(pageSize_))
+  {
+    table_.erase(pageId);
+    frame->valid = false;
+    frame->pins = 0;
+    unpinned_.notify_all();
+    throw std::runtime_error("cannot read a page of " + path_);
+  }
+  return PageRef(this, frame);
+}
+
+/**
+* Appends a zeroed page to the file and returns it pinned and unlatched.
+*/
+inline BufferPool::PageRef BufferPool::allocate()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint32_t pageId = pageCount_++;
+  Frame* frame;
+  while ((frame = claimFrame(pageId)) == nullptr)
+  {
+    unpinned_.wait(lock);
+  }
+  std::memset(frame->data, 0, pageSize_);
+  frame->dirty = true;
+  return PageRef(this, frame);
+}
+
+/**
+* Writes back every dirty page and syncs the file.
+*/
+inline void BufferPool::flushAll()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < frameCount_; i++)
+  {
+    if (frames_[i].valid && frames_[i].dirty)
+    {
+      writeFrame(&frames_[i]);
+    }
+  }
+  if (::fdatasync(fd_) != 0)
+  {
+    throw std::runtime_error("cannot sync " + path_);
+  }
+}
+
+/**
+* Drops every page, cached or on disk. No page may be pinned.
+*/
+inline void BufferPool::truncate()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < frameCount_; i++)
+  {
+    frames_[i].valid = false;
+    frames_[i].dirty = false;
+  }
+  table_.clear();
+  pageCount_ = 0;
+  if (::ftruncate(fd_, 0) != 0)
+  {
+    throw std::runtime_error("cannot truncate " + path_);
+  }
+}
+
+inline size_t BufferPool::pageSize() const
+{
+  return pageSize_;
+}
+
+inline size_t BufferPool::frameCount() const
+{
+  return frameCount_;
+}
+
+inline uint32_t BufferPool::pageCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pageCount_;
+}
+
+inline uint64_t BufferPool::hits() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+inline uint64_t BufferPool::misses() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+/**
+* The number of pages written back, by eviction or flushAll().
+*/
+inline uint64_t BufferPool::writes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return writes_;
+}
+
+/**
+* Finds a frame for pageId with the CLOCK hand, evicting its page, and
+* returns it pinned once and mapped to pageId. Two full sweeps without a
+* victim mean every frame is pinned; then it returns nullptr and the
+* caller waits on unpinned_. Called with mutex_ held.
+*/
+inline BufferPool::Frame* BufferPool::claimFrame(uint32_t pageId)
+{
+  for (size_t step = 0; step < 2 * frameCount_; step++)
+  {
+    Frame* frame = &frames_[hand_];
+    hand_ = (hand_ + 1) % frameCount_;
+    if (frame->valid && frame->pins > 0)
+    {
+      continue;
+    }
+    if (frame->valid && frame->referenced)
+    {
+      frame->referenced = false;
+      continue;
+    }
+    if (frame->valid)
+    {
+      if (frame->dirty)
+      {
+        writeFrame(frame);
+      }
+      table_.erase(frame->pageId);
+    }
+    frame->pageId = pageId;
+    frame->pins = 1;
+    frame->valid = true;
+    frame->referenced = true;
+    frame->dirty = false;
+    table_[pageId] = frame;
+    return frame;
+  }
+  return nullptr;
+}
+
+/**
+* Writes a frame's page back to the file. Called with mutex_ held.
+*/
+inline void BufferPool::writeFrame(Frame* frame)
+{
+  ssize_t written = ::pwrite(fd_, frame->data, pageSize_, static_cast<off_t>(frame->pageId) * pageSize_);
+  if (written != static_cast<ssize_t>(pageSize_))
+  {
+    throw std::runtime_error("cannot write a page of " + path_);
+  }
+  frame->dirty = false;
+  writes_++;
+}
+
+inline void BufferPool::unpin(Frame* frame, bool dirty)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  frame->dirty = frame->dirty || dirty;
+  if (--frame->pins == 0)
+  {
+    unpinned_.notify_all();
+  }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BufferPool class.
+  ---------------------------------------------
+*/
+
+#endif
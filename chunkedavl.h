@@ -0,0 +1,442 @@
+#ifndef CHUNKEDAVL_H
+#define CHUNKEDAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <utility>
+#include "avlbst.h"
+#include "sortedrun.h"
+
+/**
+* A SortedRun used as a chunk of a ChunkedAVLTree, with the bulk moves
+* that splitting and merging chunks need.
+*/
+template <typename Key, typename Value, size_t K>
+class ChunkRun : public SortedRun<Key, Value, K>
+{
+public:
+    typedef typename SortedRun<Key, Value, K>::item_type item_type;
+
+    void moveTailTo(size_t from, ChunkRun<Key, Value, K>& dest);
+    void appendFrom(ChunkRun<Key, Value, K>& src);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ChunkRun class.
+  ---------------------------------------------
+*/
+
+/**
+* Moves the items at [from, size()) to the end of dest.
+* @precondition they all sort after the items already in dest, and fit
+*/
+template<typename Key, typename Value, size_t K>
+void ChunkRun<Key, Value, K>::moveTailTo(size_t from, ChunkRun<Key, Value, K>& dest)
+{
+  for (size_t i = from; i < this->size_; i++)
+  {
+    new (dest.slot(dest.size_)) item_type(std::move(*this->slot(i)));
+    dest.size_++;
+    this->slot(i)->~item_type();
+  }
+  this->size_ = from;
+}
+
+/**
+* Moves every item of src to the end of this run, leaving src empty.
+*/
+template<typename Key, typename Value, size_t K>
+void ChunkRun<Key, Value, K>::appendFrom(ChunkRun<Key, Value, K>& src)
+{
+  src.moveTailTo(0, *this);
+}
+
+/*
+  -------------------------------------------
+  End implementations for the ChunkRun class.
+  -------------------------------------------
+*/
+
+/**
+* A map stored as an AVL tree of sorted chunks of up to K entries. Each
+* tree node is keyed by its chunk's fence: every key in the chunk is at
+* least the fence and below the next chunk's fence. The first chunk also
+* takes keys below its fence until it next splits.
+*
+* Chunks split in half when full and merge with a neighbour when they fall
+* under a quarter full, so the tree holds about n / K nodes and scans walk
+* mostly contiguous memory.
+*/
+template <typename Key, typename Value, size_t K = 32>
+class ChunkedAVLTree : protected AVLTree<Key, ChunkRun<Key, Value, K>*>
+{
+public:
+    typedef ChunkRun<Key, Value, K> Chunk;
+    typedef std::pair<const Key, Value> item_type;
+
+    ChunkedAVLTree();
+    virtual ~ChunkedAVLTree();
+    // the tree's values are owning chunk pointers, which a node copy would share
+    ChunkedAVLTree(const ChunkedAVLTree&) = delete;
+    ChunkedAVLTree& operator=(const ChunkedAVLTree&) = delete;
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t chunkCount() const;
+    using AVLTree<Key, Chunk*>::isBalanced;
+
+    /**
+    * An in-order iterator over individual entries.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        item_type& operator*() const;
+        item_type* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ChunkedAVLTree<Key, Value, K>;
+        iterator(Node<Key, Chunk*>* node, size_t index);
+        Node<Key, Chunk*>* node_;
+        size_t index_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    Node<Key, Chunk*>* chunkFor(const Key& key) const;
+    void split(Node<Key, Chunk*>* node);
+
+    size_t chunks_;
+};
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the ChunkedAVLTree::iterator class.
+  -------------------------------------------------------------
+*/
+
+template<typename Key, typename Value, size_t K>
+ChunkedAVLTree<Key, Value, K>::iterator::iterator(Node<Key, Chunk*>* node, size_t index) :
+    node_(node), index_(index)
+{
+
+}
+
+/**
+* A default constructor that initializes the iterator to NULL.
+*/
+template<typename Key, typename Value, size_t K>
+ChunkedAVLTree<Key, Value, K>::iterator::iterator() :
+    node_(NULL), index_(0)
+{
+
+}
+
+template<typename Key, typename Value, size_t K>
+typename ChunkedAVLTree<Key, Value, K>::item_type&
+ChunkedAVLTree<Key, Value, K>::iterator::operator*() const
+{
+  return node_->getValue()->at(index_);
+}
+
+template<typename Key, typename Value, size_t K>
+typename ChunkedAVLTree<Key, Value, K>::item_type*
+ChunkedAVLTree<Key, Value, K>::iterator::operator->() const
+{
+  return &(node_->getValue()->at(index_));
+}
+
+template<typename Key, typename Value, size_t K>
+bool ChunkedAVLTree<Key, Value, K>::iterator::operator==(const iterator& rhs) const
+{
+  return node_ == rhs.node_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, size_t K>
+bool ChunkedAVLTree<Key, Value, K>::iterator::operator!=(const iterator& rhs) const
+{
+  return !(*this == rhs);
+}
+
+/**
+* Steps within the chunk, moving to the successor chunk at its end.
+*/
+template<typename Key, typename Value, size_t K>
+typename ChunkedAVLTree<Key, Value, K>::iterator&
+ChunkedAVLTree<Key, Value, K>::iterator::operator++()
+{
+  index_++;
+  if (index_ == node_->getValue()->size())
+  {
+    node_ = ChunkedAVLTree<Key, Value, K>::successor(node_);
+    index_ = 0;
+  }
+  return *this;
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the ChunkedAVLTree::iterator class.
+  -----------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the ChunkedAVLTree class.
+  ----------------------------------------------------
+*/
+
+template<typename Key, typename Value, size_t K>
+ChunkedAVLTree<Key, Value, K>::ChunkedAVLTree() :
+    chunks_(0)
+{
+
+}
+
+template<typename Key, typename Value, size_t K>
+ChunkedAVLTree<Key, Value, K>::~ChunkedAVLTree()
+{
+  clear();
+}
+
+/**
+* Inserts into the chunk covering the key, splitting it first if full.
+* If key is already in the tree its value is overwritten.
+*/
+template<typename Key, typename Value, size_t K>
+void ChunkedAVLTree<Key, Value, K>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  Node<Key, Chunk*>* node = chunkFor(keyValuePair.first);
+  if (node == nullptr)
+  {
+    Chunk* chunk = new Chunk;
+    chunk->insertAt(0, keyValuePair);
+    AVLTree<Key, Chunk*>::insert(std::make_pair(keyValuePair.first, chunk));
+    chunks_++;
+    return;
+  }
+
+  Chunk* chunk = node->getValue();
+  size_t index = chunk->lowerBound(keyValuePair.first);
+  if (index < chunk->size() && chunk->at(index).first == keyValuePair.first)
+  {
+    chunk->at(index).second = keyValuePair.second;
+    return;
+  }
+  if (chunk->full())
+  {
+    split(node);
+    node = chunkFor(keyValuePair.first);
+    chunk = node->getValue();
+    index = chunk->lowerBound(keyValuePair.first);
+  }
+  chunk->insertAt(index, keyValuePair);
+}
+
+/**
+* Removes the key from its chunk, then merges an underfull chunk into a
+* neighbour, dropping the emptied chunk's node from the tree.
+*/
+template<typename Key, typename Value, size_t K>
+void ChunkedAVLTree<Key, Value, K>::remove(const Key& key)
+{
+  Node<Key, Chunk*>* node = chunkFor(key);
+  if (node == nullptr)
+  {
+    return;
+  }
+  Chunk* chunk = node->getValue();
+  size_t index = chunk->indexOf(key);
+  if (index == chunk->size())
+  {
+    return;
+  }
+  chunk->eraseAt(index);
+  if (!chunk->empty() && chunk->size() >= K / 4)
+  {
+    return;
+  }
+
+  Node<Key, Chunk*>* next = this->successor(node);
+  Node<Key, Chunk*>* prev = this->predecessor(node);
+  Node<Key, Chunk*>* victim = nullptr;
+  if (next != nullptr && chunk->size() + next->getValue()->size() <= K)
+  {
+    //next's keys are above our fence, so they can join this chunk
+    chunk->appendFrom(*next->getValue());
+    victim = next;
+  }
+  else if (prev != nullptr && chunk->size() + prev->getValue()->size() <= K)
+  {
+    prev->getValue()->appendFrom(*chunk);
+    victim = node;
+  }
+  else if (chunk->empty())
+  {
+    victim = node;
+  }
+
+  if (victim != nullptr)
+  {
+    Key fence = victim->getKey();
+    delete victim->getValue();
+    AVLTree<Key, Chunk*>::remove(fence);
+    chunks_--;
+  }
+}
+
+/**
+* Frees every chunk and node.
+*/
+template<typename Key, typename Value, size_t K>
+void ChunkedAVLTree<Key, Value, K>::clear()
+{
+  for (Node<Key, Chunk*>* node = this->getSmallestNode(); node != nullptr; node = this->successor(node))
+  {
+    delete node->getValue();
+  }
+  AVLTree<Key, Chunk*>::clear();
+  chunks_ = 0;
+}
+
+template<typename Key, typename Value, size_t K>
+bool ChunkedAVLTree<Key, Value, K>::empty() const
+{
+  return AVLTree<Key, Chunk*>::empty();
+}
+
+/**
+* Returns the number of chunks, i.e. tree nodes.
+*/
+template<typename Key, typename Value, size_t K>
+size_t ChunkedAVLTree<Key, Value, K>::chunkCount() const
+{
+  return chunks_;
+}
+
+template<typename Key, typename Value, size_t K>
+typename ChunkedAVLTree<Key, Value, K>::iterator ChunkedAVLTree<Key, Value, K>::begin() const
+{
+  return iterator(this->getSmallestNode(), 0);
+}
+
+template<typename Key, typename Value, size_t K>
+typename ChunkedAVLTree<Key, Value, K>::iterator ChunkedAVLTree<Key, Value, K>::end() const
+{
+  return iterator(NULL, 0);
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<typename Key, typename Value, size_t K>
+typename ChunkedAVLTree<Key, Value, K>::iterator ChunkedAVLTree<Key, Value, K>::find(const Key& key) const
+{
+  Node<Key, Chunk*>* node = chunkFor(key);
+  if (node == nullptr)
+  {
+    return end();
+  }
+  size_t index = node->getValue()->indexOf(key);
+  if (index == node->getValue()->size())
+  {
+    return end();
+  }
+  return iterator(node, index);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, size_t K>
+Value& ChunkedAVLTree<Key, Value, K>::operator[](const Key& key)
+{
+  iterator it = find(key);
+  if(it == end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+template<typename Key, typename Value, size_t K>
+Value const & ChunkedAVLTree<Key, Value, K>::operator[](const Key& key) const
+{
+  iterator it = find(key);
+  if(it == end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+
+/**
+* Returns the node whose chunk covers key: the one with the greatest fence
+* not above key, or the first chunk if key is below every fence. Returns
+* nullptr only when the tree is empty.
+*/
+template<typename Key, typename Value, size_t K>
+Node<Key, typename ChunkedAVLTree<Key, Value, K>::Chunk*>*
+ChunkedAVLTree<Key, Value, K>::chunkFor(const Key& key) const
+{
+  Node<Key, Chunk*>* floor = nullptr;
+  Node<Key, Chunk*>* currNode = this->root_;
+  while (currNode != nullptr)
+  {
+    if (key < currNode->getKey())
+    {
+      currNode = currNode->getLeft();
+    }
+    else
+    {
+      floor = currNode;
+      currNode = currNode->getRight();
+    }
+  }
+  if (floor == nullptr)
+  {
+    return this->getSmallestNode();
+  }
+  return floor;
+}
+
+/**
+* Moves the upper half of a full chunk into a new chunk fenced by its
+* first key.
+*/
+template<typename Key, typename Value, size_t K>
+void ChunkedAVLTree<Key, Value, K>::split(Node<Key, Chunk*>* node)
+{
+  Chunk* chunk = node->getValue();
+  if (chunk->at(0).first < node->getKey())
+  {
+    //first chunk holding keys below its fence: re-fence it at its smallest
+    //key so the new fence cannot collide with the old one
+    Key oldFence = node->getKey();
+    AVLTree<Key, Chunk*>::remove(oldFence);
+    AVLTree<Key, Chunk*>::insert(std::make_pair(chunk->at(0).first, chunk));
+  }
+  Chunk* upper = new Chunk;
+  chunk->moveTailTo(K / 2, *upper);
+  AVLTree<Key, Chunk*>::insert(std::make_pair(upper->at(0).first, upper));
+  chunks_++;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the ChunkedAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef FLATMAP_H
+#define FLATMAP_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/**
+* An ordered map stored as a sorted, contiguous vector of pairs, for
+* read-mostly tables. Lookups are binary searches over one array and scans
+* are sequential. Single inserts and removes shift the tail (O(n)), so bulk
+* loads should go through the batched insert(first, last), which merges in
+* one pass.
+*
+* Items are std::pair<Key, Value> rather than std::pair<const Key, Value>
+* since they are moved around inside the vector; callers must not change
+* a key through an iterator.
+*/
+template <typename Key, typename Value>
+class FlatMap
+{
+public:
+    typedef std::pair<Key, Value> item_type;
+    typedef typename std::vector<item_type>::iterator iterator;
+    typedef typename std::vector<item_type>::const_iterator const_iterator;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    static bool keyLess(const item_type& item, const Key& key);
+    static bool itemLess(const item_type& lhs, const item_type& rhs);
+
+    std::vector<item_type> items_;
+};
+
+/*
+  --------------------------------------------
+  Begin implementations for the FlatMap class.
+  --------------------------------------------
+*/
+
+/**
+* Inserts a single pair, shifting later items up.
+* If key is already present its value is overwritten.
+*/
+template<typename Key, typename Value>
+void FlatMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  iterator it = std::lower_bound(items_.begin(), items_.end(), keyValuePair.first, keyLess);
+  if (it != items_.end() && it->first == keyValuePair.first)
+  {
+    it->second = keyValuePair.second;
+    return;
+  }
+  items_.insert(it, item_type(keyValuePair.first, keyValuePair.second));
+}
+
+/**
+* Inserts a range of pairs in O(n + m log m): the batch is sorted on its
+* own, then merged with the existing items into a fresh vector in one
+* pass. On duplicate keys the batch wins, and the later of two batch
+* entries wins, matching repeated single inserts.
+*/
+template<typename Key, typename Value>
+template<typename InputIt>
+void FlatMap<Key, Value>::insert(InputIt first, InputIt last)
+{
+  std::vector<item_type> batch;
+  for (; first != last; ++first)
+  {
+    batch.push_back(item_type(first->first, first->second));
+  }
+  if (batch.empty())
+  {
+    return;
+  }
+  std::stable_sort(batch.begin(), batch.end(), itemLess);
+
+  std::vector<item_type> merged;
+  merged.reserve(items_.size() + batch.size());
+  size_t i = 0, j = 0;
+  while (j < batch.size())
+  {
+    //skip to the last of a run of equal batch keys
+    while (j + 1 < batch.size() && batch[j + 1].first == batch[j].first)
+    {
+      j++;
+    }
+    while (i < items_.size() && items_[i].first < batch[j].first)
+    {
+      merged.push_back(std::move(items_[i++]));
+    }
+    if (i < items_.size() && items_[i].first == batch[j].first)
+    {
+      i++;
+    }
+    merged.push_back(std::move(batch[j++]));
+  }
+  while (i < items_.size())
+  {
+    merged.push_back(std::move(items_[i++]));
+  }
+  items_.swap(merged);
+}
+
+/**
+* Removes the key if present, shifting later items down.
+*/
+template<typename Key, typename Value>
+void FlatMap<Key, Value>::remove(const Key& key)
+{
+  iterator it = find(key);
+  if (it != items_.end())
+  {
+    items_.erase(it);
+  }
+}
+
+template<typename Key, typename Value>
+void FlatMap<Key, Value>::clear()
+{
+  items_.clear();
+}
+
+template<typename Key, typename Value>
+bool FlatMap<Key, Value>::empty() const
+{
+  return items_.empty();
+}
+
+template<typename Key, typename Value>
+size_t FlatMap<Key, Value>::size() const
+{
+  return items_.size();
+}
+
+template<typename Key, typename Value>
+typename FlatMap<Key, Value>::iterator FlatMap<Key, Value>::begin()
+{
+  return items_.begin();
+}
+
+template<typename Key, typename Value>
+typename FlatMap<Key, Value>::iterator FlatMap<Key, Value>::end()
+{
+  return items_.end();
+}
+
+template<typename Key, typename Value>
+typename FlatMap<Key, Value>::const_iterator FlatMap<Key, Value>::begin() const
+{
+  return items_.begin();
+}
+
+template<typename Key, typename Value>
+typename FlatMap<Key, Value>::const_iterator FlatMap<Key, Value>::end() const
+{
+  return items_.end();
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the map
+*/
+template<typename Key, typename Value>
+typename FlatMap<Key, Value>::iterator FlatMap<Key, Value>::find(const Key& key)
+{
+  iterator it = std::lower_bound(items_.begin(), items_.end(), key, keyLess);
+  if (it != items_.end() && it->first == key)
+  {
+    return it;
+  }
+  return items_.end();
+}
+
+template<typename Key, typename Value>
+typename FlatMap<Key, Value>::const_iterator FlatMap<Key, Value>::find(const Key& key) const
+{
+  const_iterator it = std::lower_bound(items_.begin(), items_.end(), key, keyLess);
+  if (it != items_.end() && it->first == key)
+  {
+    return it;
+  }
+  return items_.end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value& FlatMap<Key, Value>::operator[](const Key& key)
+{
+  iterator it = find(key);
+  if(it == items_.end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+template<typename Key, typename Value>
+Value const & FlatMap<Key, Value>::operator[](const Key& key) const
+{
+  const_iterator it = find(key);
+  if(it == items_.end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+
+template<typename Key, typename Value>
+bool FlatMap<Key, Value>::keyLess(const item_type& item, const Key& key)
+{
+  return item.first < key;
+}
+
+template<typename Key, typename Value>
+bool FlatMap<Key, Value>::itemLess(const item_type& lhs, const item_type& rhs)
+{
+  return lhs.first < rhs.first;
+}
+
+/*
+  ------------------------------------------
+  End implementations for the FlatMap class.
+  ------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef INDEXEDAVL_H
+#define INDEXEDAVL_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVL tree paired with an open-addressing hash index from each key to
+* its node. find, operator[], remove and overwriting inserts go through
+* the index in expected O(1); iteration and lowerBound use the tree, so
+* range scans stay ordered. Inserting a new key and removing pay for both
+* structures.
+*
+* The index uses linear probing at a load factor of at most 1/2. Each
+* slot keeps the key's hash next to the node pointer, so a probe only
+* touches a node whose hash matches. Nodes are relinked but never moved
+* by the tree, so the pointers stay valid across rotations. Deletion
+* shifts later entries of the probe run back rather than leaving
+* tombstones. Keys need std::hash.
+*
+* Only the operations that keep the index in sync are offered: the tree
+* is held as a protected base, without relaxed mode, lazy removal, node
+* handles, merge or defragment.
+*/
+template <class Key, class Value>
+class IndexedAVLMap : protected AVLTree<Key, Value>
+{
+public:
+    typedef typename AVLTree<Key, Value>::iterator iterator;
+
+    IndexedAVLMap();
+    IndexedAVLMap(const IndexedAVLMap<Key, Value>& other);
+    IndexedAVLMap(IndexedAVLMap<Key, Value>&& other) noexcept;
+    IndexedAVLMap<Key, Value>& operator=(const IndexedAVLMap<Key, Value>& other);
+    IndexedAVLMap<Key, Value>& operator=(IndexedAVLMap<Key, Value>&& other) noexcept;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    iterator erase(iterator pos);
+    void clear();
+
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+
+    using AVLTree<Key, Value>::begin;
+    using AVLTree<Key, Value>::end;
+    using AVLTree<Key, Value>::size;
+    using AVLTree<Key, Value>::empty;
+    using AVLTree<Key, Value>::isBalanced;
+    using AVLTree<Key, Value>::print;
+
+    size_t indexCapacity() const;
+
+protected:
+    struct Slot
+    {
+        uint64_t hash;
+        Node<Key, Value>* node;  // nullptr for an empty slot
+    };
+
+    static const size_t MIN_CAPACITY = 16;
+
+    Node<Key, Value>* lookup(const Key& key) const;
+    void indexInsert(uint64_t hash, Node<Key, Value>* node);
+    void indexErase(const Key& key);
+    void place(uint64_t hash, Node<Key, Value>* node);
+    void grow();
+    void rebuildIndex(size_t capacity);
+
+    std::vector<Slot> slots_;
+    size_t mask_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the IndexedAVLMap class.
+  --------------------------------------------------
+*/
+
+template<class Key, class Value>
+IndexedAVLMap<Key, Value>::IndexedAVLMap() :
+    slots_(MIN_CAPACITY), mask_(MIN_CAPACITY - 1)
+{
+
+}
+
+/**
+* Copies the tree in O(n) and indexes the copied nodes.
+*/
+template<class Key, class Value>
+IndexedAVLMap<Key, Value>::IndexedAVLMap(const IndexedAVLMap<Key, Value>& other) :
+    AVLTree<Key, Value>(other), mask_(0)
+{
+  rebuildIndex(other.slots_.size());
+}
+
+/**
+* Takes other's nodes and index in O(1), leaving other empty. Nothing is
+* allocated: other is left without index slots until its next insert.
+*/
+template<class Key, class Value>
+IndexedAVLMap<Key, Value>::IndexedAVLMap(IndexedAVLMap<Key, Value>&& other) noexcept :
+    AVLTree<Key, Value>(std::move(other)), slots_(std::move(other.slots_)), mask_(other.mask_)
+{
+  other.slots_.clear();
+  other.mask_ = 0;
+}
+
+template<class Key, class Value>
+IndexedAVLMap<Key, Value>& IndexedAVLMap<Key, Value>::operator=(const IndexedAVLMap<Key, Value>& other)
+{
+  if (this != &other)
+  {
+    AVLTree<Key, Value>::operator=(other);
+    rebuildIndex(other.slots_.size());
+  }
+  return *this;
+}
+
+template<class Key, class Value>
+IndexedAVLMap<Key, Value>& IndexedAVLMap<Key, Value>::operator=(IndexedAVLMap<Key, Value>&& other) noexcept
+{
+  if (this != &other)
+  {
+    AVLTree<Key, Value>::operator=(std::move(other));
+    slots_ = std::move(other.slots_);
+    mask_ = other.mask_;
+    other.slots_.clear();
+    other.mask_ = 0;
+  }
+  return *this;
+}
+
+/**
+* If key is already in the map, the current value is overwritten, found
+* through the index without a descent.
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  if (slots_.empty())
+  {
+    rebuildIndex(MIN_CAPACITY);
+  }
+  uint64_t hash = BloomFilter::hashOf(keyValuePair.first);
+  for (size_t i = hash & mask_; slots_[i].node != nullptr; i = (i + 1) & mask_)
+  {
+    if (slots_[i].hash == hash && slots_[i].node->getKey() == keyValuePair.first)
+    {
+      slots_[i].node->setValue(keyValuePair.second);
+      return;
+    }
+  }
+  AVLNode<Key, Value>* parent;
+  size_t depth;
+  this->findSlot(keyValuePair.first, parent, depth);
+  AVLNode<Key, Value>* node = new AVLNode<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
+  this->linkNode(node, parent, depth);
+  indexInsert(hash, node);
+}
+
+/**
+* Removes the key if it exists. An absent key costs one index probe.
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::remove(const Key& key)
+{
+  Node<Key, Value>* node = lookup(key);
+  if (node == nullptr)
+  {
+    return;
+  }
+  indexErase(key);
+  this->removeNode(static_cast<AVLNode<Key, Value>*>(node));
+}
+
+/**
+* Removes the entry at pos, which must be a valid iterator into this map,
+* and returns an iterator to the next entry.
+*/
+template<class Key, class Value>
+typename IndexedAVLMap<Key, Value>::iterator IndexedAVLMap<Key, Value>::erase(iterator pos)
+{
+  indexErase(pos->first);
+  return AVLTree<Key, Value>::erase(pos);
+}
+
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::clear()
+{
+  AVLTree<Key, Value>::clear();
+  slots_.assign(MIN_CAPACITY, Slot());
+  mask_ = MIN_CAPACITY - 1;
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value>
+typename IndexedAVLMap<Key, Value>::iterator IndexedAVLMap<Key, Value>::find(const Key& key) const
+{
+  return this->iteratorAt(lookup(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& IndexedAVLMap<Key, Value>::operator[](const Key& key)
+{
+  Node<Key, Value>* node = lookup(key);
+  if(node == nullptr) throw std::out_of_range("Invalid key");
+  return node->getValue();
+}
+
+template<class Key, class Value>
+Value const & IndexedAVLMap<Key, Value>::operator[](const Key& key) const
+{
+  Node<Key, Value>* node = lookup(key);
+  if(node == nullptr) throw std::out_of_range("Invalid key");
+  return node->getValue();
+}
+
+/**
+* Returns an iterator to the first item whose key is not below key, found
+* by descending the tree.
+*/
+template<class Key, class Value>
+typename IndexedAVLMap<Key, Value>::iterator IndexedAVLMap<Key, Value>::lowerBound(const Key& key) const
+{
+  Node<Key, Value>* bound = nullptr;
+  Node<Key, Value>* currNode = BinarySearchTree<Key, Value>::root_;
+  while (currNode != nullptr)
+  {
+    if (currNode->getKey() < key)
+    {
+      currNode = currNode->getRight();
+    }
+    else
+    {
+      bound = currNode;
+      currNode = currNode->getLeft();
+    }
+  }
+  return this->iteratorAt(bound);
+}
+
+/**
+* The number of slots in the index.
+*/
+template<class Key, class Value>
+size_t IndexedAVLMap<Key, Value>::indexCapacity() const
+{
+  return slots_.size();
+}
+
+/**
+* Returns the node holding key, or nullptr, using only the index. A
+* moved-from map has no slots and holds nothing.
+*/
+template<class Key, class Value>
+Node<Key, Value>* IndexedAVLMap<Key, Value>::lookup(const Key& key) const
+{
+  if (slots_.empty())
+  {
+    return nullptr;
+  }
+  uint64_t hash = BloomFilter::hashOf(key);
+  for (size_t i = hash & mask_; slots_[i].node != nullptr; i = (i + 1) & mask_)
+  {
+    if (slots_[i].hash == hash && slots_[i].node->getKey() == key)
+    {
+      return slots_[i].node;
+    }
+  }
+  return nullptr;
+}
+
+/**
+* Adds a node whose key is not yet indexed, doubling the index first if
+* it would pass half full. size() already counts the node.
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::indexInsert(uint64_t hash, Node<Key, Value>* node)
+{
+  if (2 * this->size() > slots_.size())
+  {
+    grow();
+  }
+  place(hash, node);
+}
+
+/**
+* Removes key from the index. Later entries of its probe run move back
+* into the gap when their home slot allows it, so that lookups never
+* stop early at a hole.
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::indexErase(const Key& key)
+{
+  if (slots_.empty())
+  {
+    return;
+  }
+  uint64_t hash = BloomFilter::hashOf(key);
+  size_t hole = hash & mask_;
+  while (slots_[hole].node != nullptr && !(slots_[hole].hash == hash && slots_[hole].node->getKey() == key))
+  {
+    hole = (hole + 1) & mask_;
+  }
+  if (slots_[hole].node == nullptr)
+  {
+    return;
+  }
+  for (size_t i = (hole + 1) & mask_; slots_[i].node != nullptr; i = (i + 1) & mask_)
+  {
+    //an entry may fill the hole if the hole lies on its way from home to i
+    size_t home = slots_[i].hash & mask_;
+    if (((i - home) & mask_) >= ((i - hole) & mask_))
+    {
+      slots_[hole] = slots_[i];
+      hole = i;
+    }
+  }
+  slots_[hole].node = nullptr;
+}
+
+/**
+* Puts an entry in the first free slot of its probe run.
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::place(uint64_t hash, Node<Key, Value>* node)
+{
+  size_t i = hash & mask_;
+  while (slots_[i].node != nullptr)
+  {
+    i = (i + 1) & mask_;
+  }
+  slots_[i].hash = hash;
+  slots_[i].node = node;
+}
+
+/**
+* Doubles the index, rehashing from the stored hashes rather than from
+* the tree, so no node is touched.
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::grow()
+{
+  std::vector<Slot> old(2 * slots_.size());
+  old.swap(slots_);
+  mask_ = slots_.size() - 1;
+  for (size_t i = 0; i < old.size(); i++)
+  {
+    if (old[i].node != nullptr)
+    {
+      place(old[i].hash, old[i].node);
+    }
+  }
+}
+
+/**
+* Re-creates the index with at least capacity slots (a power of two, at
+* most half full) from the nodes of the tree, in O(n).
+*/
+template<class Key, class Value>
+void IndexedAVLMap<Key, Value>::rebuildIndex(size_t capacity)
+{
+  size_t slots = MIN_CAPACITY;
+  while (slots < capacity || slots < 2 * this->size())
+  {
+    slots *= 2;
+  }
+  slots_.assign(slots, Slot());
+  mask_ = slots - 1;
+  for (Node<Key, Value>* currNode = this->getSmallestNode(); currNode != nullptr; currNode = this->successor(currNode))
+  {
+    place(BloomFilter::hashOf(currNode->getKey()), currNode);
+  }
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the IndexedAVLMap class.
+  ------------------------------------------------
+*/
+
+#endif
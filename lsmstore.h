@@ -0,0 +1,710 @@
+#ifndef LSMSTORE_H
+#define LSMSTORE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "avlbst.h"
+#include "snapshot.h"
+#include "bloomfilter.h"
+
+/**
+* What the store keeps per key in the memtable and in run files: the value,
+* or a tombstone that hides older versions of the key.
+*/
+template <typename Value>
+struct LSMSlot
+{
+    Value value;
+    bool deleted;
+};
+
+/**
+* Lets the memtable be printed like any other tree.
+*/
+template <typename Value>
+std::ostream& operator<<(std::ostream& os, const LSMSlot<Value>& slot)
+{
+  if (slot.deleted)
+    return os << "(removed)";
+  return os << slot.value;
+}
+
+/**
+* A log-structured merge store. Writes go to an AVLTree memtable; when it
+* holds memtableLimit keys it is flushed, in key order through its
+* iterator, to an immutable sorted run file (a MappedSnapshot with a fence
+* index), and a fresh memtable takes over. Each run also gets a blocked
+* bloom filter in memory. A lookup checks the memtable, then the runs from
+* newest to oldest, skipping every run whose bloom filter rules the key out.
+*
+* Compaction is tiered. A run's tier is how many times maxRuns goes into
+* its size in memtables, logarithmically: fresh flushes are tier 0, the
+* merge of maxRuns of them tier 1, and so on. A background thread merges
+* maxRuns or more adjacent runs of the same tier into one, dropping
+* overwritten versions (and tombstones, when the oldest run is among the
+* inputs), so each key is rewritten about once per tier rather than on
+* every compaction, and lookups visit a bounded number of runs per tier.
+* The list of live runs is kept in a MANIFEST file that is replaced
+* atomically, so the directory is always consistent on disk.
+*
+* All members are thread-safe. The memtable is not durable: keys written
+* since the last flush are lost if the process dies (the destructor
+* flushes). Key and Value must be trivially copyable, and Key must work
+* with std::hash.
+*/
+template <typename Key, typename Value>
+class LSMStore
+{
+public:
+    typedef LSMSlot<Value> slot_type;
+
+    static const size_t DEFAULT_MEMTABLE_LIMIT = 1 << 20;
+    static const size_t DEFAULT_MAX_RUNS = 4;
+
+    explicit LSMStore(const std::string& dir, size_t memtableLimit = DEFAULT_MEMTABLE_LIMIT,
+        size_t maxRuns = DEFAULT_MAX_RUNS, double falsePositiveRate = 0.01);
+    ~LSMStore();
+    LSMStore(const LSMStore&) = delete;
+    LSMStore& operator=(const LSMStore&) = delete;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool lookup(const Key& key, Value& value) const;
+
+    void flush();
+    void waitForCompaction();
+    size_t runCount() const;
+    size_t memtableSize() const;
+    size_t bloomSkips() const;
+
+protected:
+    // An immutable sorted run and the bloom filter over its keys
+    struct Run
+    {
+        uint64_t id;
+        MappedSnapshot<Key, slot_type> snapshot;
+        BloomFilter bloom;
+    };
+    typedef std::vector<std::shared_ptr<Run> > RunList;
+    typedef AVLTree<Key, slot_type> Memtable;
+
+    void put(const Key& key, const slot_type& slot);
+    void flushMemtable(bool onlyIfFull);
+    void recover();
+    std::string runPath(uint64_t id) const;
+    std::shared_ptr<Run> openRun(uint64_t id);
+    void writeManifest(const RunList& runs);
+    bool compactionDue(const RunList& runs, size_t& first, size_t& count) const;
+    void compactLoop();
+    void compact(const RunList& inputs, size_t first);
+    static bool findIn(const Memtable& table, const Key& key, slot_type& slot);
+
+    std::string dir_;
+    size_t memtableLimit_;
+    size_t maxRuns_;
+    double falsePositiveRate_;
+
+    // guards the fields below; never held across file I/O
+    mutable std::mutex mutex_;
+    Memtable memtable_;
+    std::shared_ptr<const Memtable> flushing_;
+    std::shared_ptr<const RunList> runs_;   // oldest first, replaced on change
+    uint64_t nextRunId_;
+    bool compacting_;
+    bool compactionFailed_;
+    bool stopping_;
+    std::condition_variable compactWanted_;
+    std::condition_variable compactDone_;
+
+    // serializes run list changes and MANIFEST writes
+    std::mutex installMutex_;
+    mutable std::atomic<size_t> bloomSkips_;
+    std::thread compactor_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the LSMStore class.
+  ---------------------------------------------
+*/
+
+/**
+* Opens the store in dir, creating the directory if needed and loading
+* the runs named in its MANIFEST, then starts the compaction thread.
+* Throws std::runtime_error if the directory or a run cannot be read.
+*/
+template<typename Key, typename Value>
+LSMStore<Key, Value>::LSMStore(const std::string& dir, size_t memtableLimit, size_t maxRuns,
+    double falsePositiveRate) :
+    dir_(dir), memtableLimit_(memtableLimit == 0 ? 1 : memtableLimit),
+    maxRuns_(maxRuns < 2 ? 2 : maxRuns), falsePositiveRate_(falsePositiveRate),
+    runs_(std::make_shared<RunList>()), nextRunId_(1), compacting_(false),
+    compactionFailed_(false), stopping_(false), bloomSkips_(0)
+{
+  recover();
+  compactor_ = std::thread(&LSMStore<Key, Value>::compactLoop, this);
+}
+
+/**
+* Flushes the memtable and stops the compaction thread, letting a
+* compaction in progress finish.
+*/
+template<typename Key, typename Value>
+LSMStore<Key, Value>::~LSMStore()
+{
+  try
+  {
+    flush();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "LSMStore: final flush failed: " << e.what() << std::endl;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  compactWanted_.notify_all();
+  compactor_.join();
+}
+
+/**
+* If key is already in the store, the current value is overwritten.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  slot_type slot;
+  slot.value = keyValuePair.second;
+  slot.deleted = false;
+  put(keyValuePair.first, slot);
+}
+
+/**
+* Writes a tombstone for key, which hides it in every older run until
+* compaction drops both.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::remove(const Key& key)
+{
+  slot_type slot = slot_type();
+  slot.deleted = true;
+  put(key, slot);
+}
+
+/**
+* Copies the newest value for key into value and returns true, or returns
+* false if the key is absent or removed.
+*/
+template<typename Key, typename Value>
+bool LSMStore<Key, Value>::lookup(const Key& key, Value& value) const
+{
+  slot_type slot;
+  std::shared_ptr<const Memtable> flushing;
+  std::shared_ptr<const RunList> runs;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (findIn(memtable_, key, slot))
+    {
+      value = slot.value;
+      return !slot.deleted;
+    }
+    flushing = flushing_;
+    runs = runs_;
+  }
+  //the memtable being flushed and the runs are immutable, so no lock is needed
+  if (flushing != nullptr && findIn(*flushing, key, slot))
+  {
+    value = slot.value;
+    return !slot.deleted;
+  }
+  uint64_t hash = BloomFilter::hashOf(key);
+  for (size_t i = runs->size(); i-- > 0; )
+  {
+    const Run& run = *(*runs)[i];
+    if (!run.bloom.mayContain(hash))
+    {
+      bloomSkips_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    typename MappedSnapshot<Key, slot_type>::iterator it = run.snapshot.find(key);
+    if (it != run.snapshot.end())
+    {
+      value = it->second.value;
+      return !it->second.deleted;
+    }
+  }
+  return false;
+}
+
+/**
+* Writes the memtable to a new run now, however full it is.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::flush()
+{
+  flushMemtable(false);
+}
+
+/**
+* Blocks until no compaction is running or due, or until a compaction
+* attempt fails; the compaction thread retries a failed one later.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::waitForCompaction()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t first, count;
+  while (compacting_ || (!compactionFailed_ && compactionDue(*runs_, first, count)))
+  {
+    compactDone_.wait(lock);
+  }
+}
+
+template<typename Key, typename Value>
+size_t LSMStore<Key, Value>::runCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return runs_->size();
+}
+
+template<typename Key, typename Value>
+size_t LSMStore<Key, Value>::memtableSize() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return memtable_.size();
+}
+
+/**
+* The number of times a bloom filter spared a lookup from searching a run.
+*/
+template<typename Key, typename Value>
+size_t LSMStore<Key, Value>::bloomSkips() const
+{
+  return bloomSkips_.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::put(const Key& key, const slot_type& slot)
+{
+  bool full;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memtable_.insert(std::make_pair(key, slot));
+    full = memtable_.size() >= memtableLimit_;
+  }
+  if (full)
+  {
+    flushMemtable(true);
+  }
+}
+
+/**
+* Swaps in an empty memtable, writes the old one out as a run, and adds
+* the run to the list. Writers carry on into the new memtable while the
+* file is written, and readers still find the old one through flushing_.
+* If the run cannot be written or installed, the old memtable's entries
+* go back into the memtable, behind any newer writes, and the exception
+* is rethrown; nothing is lost and a later flush tries again.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::flushMemtable(bool onlyIfFull)
+{
+  std::lock_guard<std::mutex> install(installMutex_);
+  std::shared_ptr<const Memtable> table;
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    //another writer may have flushed while this one waited
+    if (memtable_.empty() || (onlyIfFull && memtable_.size() < memtableLimit_))
+    {
+      return;
+    }
+    table = std::make_shared<Memtable>(std::move(memtable_));
+    flushing_ = table;
+    id = nextRunId_++;
+  }
+
+  try
+  {
+    std::shared_ptr<Run> run = std::make_shared<Run>();
+    run->id = id;
+    run->bloom.reset(table->size(), falsePositiveRate_);
+    {
+      SnapshotWriter<Key, slot_type> writer(runPath(id));
+      for (typename Memtable::iterator it = table->begin(); it != table->end(); ++it)
+      {
+        writer.append(it->first, it->second);
+        run->bloom.add(BloomFilter::hashOf(it->first));
+      }
+      writer.commit();
+    }
+    run->snapshot.load(runPath(id));
+
+    std::shared_ptr<RunList> runs;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      runs = std::make_shared<RunList>(*runs_);
+    }
+    runs->push_back(run);
+    writeManifest(*runs);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      runs_ = runs;
+      flushing_.reset();
+      //a flush that reached the disk is a good moment to retry compaction
+      compactionFailed_ = false;
+    }
+    size_t first, count;
+    if (compactionDue(*runs, first, count))
+    {
+      compactWanted_.notify_one();
+    }
+  }
+  catch (...)
+  {
+    ::unlink(runPath(id).c_str());
+    //lookups may still be reading table, so it is copied rather than taken
+    Memtable restored(*table);
+    std::lock_guard<std::mutex> lock(mutex_);
+    //keys written since the swap are newer and win the merge
+    restored.merge(std::move(memtable_));
+    memtable_ = std::move(restored);
+    flushing_.reset();
+    throw;
+  }
+}
+
+/**
+* Creates the directory if needed, loads the runs listed in MANIFEST, and
+* removes any run or temporary file a crash left behind.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::recover()
+{
+  if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    throw std::runtime_error("cannot create " + dir_);
+  }
+  std::shared_ptr<RunList> runs = std::make_shared<RunList>();
+  FILE* manifest = std::fopen((dir_ + "/MANIFEST").c_str(), "r");
+  if (manifest != nullptr)
+  {
+    unsigned long long id;
+    while (std::fscanf(manifest, "%llu", &id) == 1)
+    {
+      runs->push_back(openRun(id));
+      if (id >= nextRunId_)
+      {
+        nextRunId_ = id + 1;
+      }
+    }
+    std::fclose(manifest);
+  }
+
+  DIR* listing = ::opendir(dir_.c_str());
+  if (listing == nullptr)
+  {
+    throw std::runtime_error("cannot list " + dir_);
+  }
+  while (struct dirent* entry = ::readdir(listing))
+  {
+    unsigned long long id;
+    int used = 0;
+    if (std::sscanf(entry->d_name, "run-%llu%n", &id, &used) != 1)
+    {
+      continue;
+    }
+    bool live = false;
+    for (size_t i = 0; i < runs->size(); i++)
+    {
+      live = live || ((*runs)[i]->id == id && std::string(entry->d_name + used) == ".snap");
+    }
+    if (!live)
+    {
+      ::unlink((dir_ + "/" + entry->d_name).c_str());
+    }
+  }
+  ::closedir(listing);
+  runs_ = runs;
+}
+
+template<typename Key, typename Value>
+std::string LSMStore<Key, Value>::runPath(uint64_t id) const
+{
+  return dir_ + "/run-" + std::to_string(id) + ".snap";
+}
+
+/**
+* Maps an existing run and rebuilds its bloom filter from its keys.
+*/
+template<typename Key, typename Value>
+std::shared_ptr<typename LSMStore<Key, Value>::Run> LSMStore<Key, Value>::openRun(uint64_t id)
+{
+  std::shared_ptr<Run> run = std::make_shared<Run>();
+  run->id = id;
+  run->snapshot.load(runPath(id));
+  run->bloom.reset(run->snapshot.size(), falsePositiveRate_);
+  for (typename MappedSnapshot<Key, slot_type>::iterator it = run->snapshot.begin();
+       it != run->snapshot.end(); ++it)
+  {
+    run->bloom.add(BloomFilter::hashOf(it->first));
+  }
+  return run;
+}
+
+/**
+* Replaces MANIFEST with the ids of runs, oldest first. The new list is
+* synced under a temporary name and renamed over the old one.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::writeManifest(const RunList& runs)
+{
+  std::string text;
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    text += std::to_string(runs[i]->id) + "\n";
+  }
+  std::string path = dir_ + "/MANIFEST";
+  std::string tmpPath = path + ".tmp";
+  int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot create " + tmpPath);
+  }
+  bool written = ::write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()) && ::fsync(fd) == 0;
+  ::close(fd);
+  if (!written || ::rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    ::unlink(tmpPath.c_str());
+    throw std::runtime_error("cannot write " + path);
+  }
+  //make the rename itself durable
+  int dirFd = ::open(dir_.c_str(), O_RDONLY);
+  if (dirFd >= 0)
+  {
+    ::fsync(dirFd);
+    ::close(dirFd);
+  }
+}
+
+/**
+* Finds the oldest stretch of at least maxRuns adjacent runs in the same
+* tier and returns whether there is one, setting first and count to its
+* position in runs. A run counts as being in the highest tier of itself
+* and the runs after it, so a small run left between two big ones waits
+* to be merged with the older big one instead of holding its tier back.
+*/
+template<typename Key, typename Value>
+bool LSMStore<Key, Value>::compactionDue(const RunList& runs, size_t& first, size_t& count) const
+{
+  std::vector<unsigned> tiers(runs.size());
+  unsigned newer = 0;
+  for (size_t i = runs.size(); i-- > 0; )
+  {
+    size_t memtables = runs[i]->snapshot.size() / memtableLimit_;
+    unsigned tier = 0;
+    for (size_t bound = maxRuns_; memtables >= bound; bound *= maxRuns_)
+    {
+      tier++;
+    }
+    newer = (tier > newer ? tier : newer);
+    tiers[i] = newer;
+  }
+  for (first = 0; first < runs.size(); first += count)
+  {
+    count = 1;
+    while (first + count < runs.size() && tiers[first + count] == tiers[first])
+    {
+      count++;
+    }
+    if (count >= maxRuns_)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+* The compaction thread: waits until compactionDue finds a stretch of
+* runs, then merges it. A failed compaction is reported and retried after
+* a delay that doubles from 100 ms up to 30 s, so a full disk does not
+* turn into a busy loop; the next successful flush cuts the delay short. Lookups keep working meanwhile.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::compactLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t first = 0, count = 0;
+  const std::chrono::milliseconds minRetryDelay(100), maxRetryDelay(30000);
+  std::chrono::milliseconds retryDelay = minRetryDelay;
+  while (true)
+  {
+    while (!stopping_ && !compactionDue(*runs_, first, count))
+    {
+      compactWanted_.wait(lock);
+    }
+    if (stopping_)
+    {
+      return;
+    }
+    if (compactionFailed_)
+    {
+      compactWanted_.wait_for(lock, retryDelay, [this] { return stopping_ || !compactionFailed_; });
+      compactionFailed_ = false;
+      retryDelay = std::min(2 * retryDelay, maxRetryDelay);
+      continue;
+    }
+    RunList inputs(runs_->begin() + first, runs_->begin() + first + count);
+    compacting_ = true;
+    lock.unlock();
+    bool failed = false;
+    try
+    {
+      compact(inputs, first);
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "LSMStore: compaction failed: " << e.what() << std::endl;
+      failed = true;
+    }
+    lock.lock();
+    compacting_ = false;
+    compactionFailed_ = failed;
+    if (!failed)
+    {
+      retryDelay = minRetryDelay;
+    }
+    compactDone_.notify_all();
+  }
+}
+
+/**
+* Merges inputs, the adjacent runs starting at position first in the run
+* list, into one run that takes their place. For a key in several runs
+* the newest version wins. Tombstones are dropped only when first is 0,
+* since then no older run is left for them to hide anything in.
+*/
+template<typename Key, typename Value>
+void LSMStore<Key, Value>::compact(const RunList& inputs, size_t first)
+{
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = nextRunId_++;
+  }
+  typedef typename MappedSnapshot<Key, slot_type>::iterator RunIterator;
+  std::vector<RunIterator> heads;
+  std::vector<RunIterator> ends;
+  size_t total = 0;
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    heads.push_back(inputs[i]->snapshot.begin());
+    ends.push_back(inputs[i]->snapshot.end());
+    total += inputs[i]->snapshot.size();
+  }
+
+  std::shared_ptr<Run> run = std::make_shared<Run>();
+  run->id = id;
+  run->bloom.reset(total, falsePositiveRate_);
+  SnapshotWriter<Key, slot_type> writer(runPath(id));
+  while (true)
+  {
+    //the smallest head key; among equal keys the newest run (the last) wins
+    size_t best = heads.size();
+    for (size_t i = 0; i < heads.size(); i++)
+    {
+      if (heads[i] != ends[i] && (best == heads.size() || !(heads[best]->first < heads[i]->first)))
+      {
+        best = i;
+      }
+    }
+    if (best == heads.size())
+    {
+      break;
+    }
+    Key key = heads[best]->first;
+    slot_type slot = heads[best]->second;
+    for (size_t i = 0; i < heads.size(); i++)
+    {
+      if (heads[i] != ends[i] && heads[i]->first == key)
+      {
+        ++heads[i];
+      }
+    }
+    if (!slot.deleted || first > 0)
+    {
+      writer.append(key, slot);
+      run->bloom.add(BloomFilter::hashOf(key));
+    }
+  }
+  bool empty = (writer.size() == 0);
+  if (!empty)
+  {
+    writer.commit();
+    run->snapshot.load(runPath(id));
+  }
+
+  std::lock_guard<std::mutex> install(installMutex_);
+  std::shared_ptr<RunList> runs = std::make_shared<RunList>();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    //only flushes append meanwhile, so the inputs have not moved
+    runs->insert(runs->end(), runs_->begin(), runs_->begin() + first);
+    if (!empty)
+    {
+      runs->push_back(run);
+    }
+    runs->insert(runs->end(), runs_->begin() + first + inputs.size(), runs_->end());
+  }
+  writeManifest(*runs);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    runs_ = runs;
+  }
+  //lookups still holding the old list keep their mappings after the unlink
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    ::unlink(runPath(inputs[i]->id).c_str());
+  }
+}
+
+template<typename Key, typename Value>
+bool LSMStore<Key, Value>::findIn(const Memtable& table, const Key& key, slot_type& slot)
+{
+  typename Memtable::iterator it = table.find(key);
+  if (it == table.end())
+  {
+    return false;
+  }
+  slot = it->second;
+  return true;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the LSMStore class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef MERKLEAVL_H
+#define MERKLEAVL_H
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also carries a digest of the live entries in its subtree
+* and a flag saying whether the digest is out of date.
+*/
+template <typename Key, typename Value>
+class MerkleAVLNode : public AVLNode<Key, Value>
+{
+public:
+    MerkleAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual MerkleAVLNode<Key, Value>* clone() const override;
+
+    uint64_t getDigest() const;
+    void setDigest(uint64_t digest);
+    bool isStale() const;
+    void setStale(bool stale);
+
+protected:
+    uint64_t digest_;
+    bool stale_;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the MerkleAVLNode class.
+  --------------------------------------------------
+*/
+
+/**
+* A new node starts stale, as it has not been hashed yet.
+*/
+template<class Key, class Value>
+MerkleAVLNode<Key, Value>::MerkleAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), digest_(0), stale_(true)
+{
+
+}
+
+/**
+* Returns an unlinked copy, keeping the balance and the digest.
+*/
+template<class Key, class Value>
+MerkleAVLNode<Key, Value>* MerkleAVLNode<Key, Value>::clone() const
+{
+    MerkleAVLNode<Key, Value>* copy = new MerkleAVLNode<Key, Value>(this->getKey(), this->getValue(), nullptr);
+    copy->copyStateFrom(*this);
+    copy->digest_ = digest_;
+    copy->stale_ = stale_;
+    return copy;
+}
+
+template<class Key, class Value>
+uint64_t MerkleAVLNode<Key, Value>::getDigest() const
+{
+    return digest_;
+}
+
+template<class Key, class Value>
+void MerkleAVLNode<Key, Value>::setDigest(uint64_t digest)
+{
+    digest_ = digest;
+}
+
+template<class Key, class Value>
+bool MerkleAVLNode<Key, Value>::isStale() const
+{
+    return stale_;
+}
+
+template<class Key, class Value>
+void MerkleAVLNode<Key, Value>::setStale(bool stale)
+{
+    stale_ = stale;
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the MerkleAVLNode class.
+  ------------------------------------------------
+*/
+
+template <class Key, class Value>
+class MerkleAVLTree;
+
+template <class Key, class Value>
+std::vector<Key> diff(const MerkleAVLTree<Key, Value>& a, const MerkleAVLTree<Key, Value>& b);
+
+/**
+* An AVL tree whose nodes each keep a digest of their subtree, so that two
+* replicas can be compared without visiting what they have in common.
+*
+* A subtree's digest is the sum (mod 2^64) of a 64-bit hash of each live
+* entry in it. Unlike a positional Merkle hash this does not depend on the
+* shape, which differs between replicas built in different orders, so equal
+* contents always give equal digests and any key range of either tree can
+* be digested in O(log n). Key and Value must work with std::hash and ==.
+*
+* Digests are kept incrementally: a change marks its node and the
+* ancestors up to the first already-stale one, and digest() or diff()
+* rehashes only the stale nodes. A run of writes between diffs therefore
+* costs about one rehash per changed path. That rehash writes to the
+* nodes, so although digest() and diff() are const they are not safe to
+* call on the same tree from several threads at once.
+*
+* Values changed in place, through operator[] or an iterator, are not
+* seen; insert the new value instead. The tree creates its nodes through
+* makeNode and copyNode, so every AVLTree path that allocates one (insert,
+* insertSorted, defragment, extract) makes a MerkleAVLNode. Nodes that
+* come from another tree, through merge or a node handle, must come from
+* another MerkleAVLTree.
+*/
+template <class Key, class Value>
+class MerkleAVLTree : public AVLTree<Key, Value>
+{
+public:
+    MerkleAVLTree();
+
+    void merge(MerkleAVLTree<Key, Value>&& other);
+    uint64_t digest() const;
+
+    friend std::vector<Key> diff<Key, Value>(const MerkleAVLTree<Key, Value>& a, const MerkleAVLTree<Key, Value>& b);
+
+protected:
+    virtual void subtreeChanged(AVLNode<Key, Value>* node) override;
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) const override;
+    virtual AVLNode<Key, Value>* copyNode(const AVLNode<Key, Value>& node, void* block) const override;
+    virtual size_t nodeSize() const override;
+
+    static uint64_t mix(uint64_t hash);
+    static uint64_t entryHash(const MerkleAVLNode<Key, Value>* node);
+    static uint64_t digestOf(const MerkleAVLNode<Key, Value>* node);
+    static void refresh(MerkleAVLNode<Key, Value>* node);
+    MerkleAVLNode<Key, Value>* root() const;
+    uint64_t digestBelow(const Key* bound, bool inclusive) const;
+    uint64_t rangeDigest(const Key* lo, const Key* hi) const;
+    const MerkleAVLNode<Key, Value>* liveNode(const Key& key) const;
+    void collectRange(const Key* lo, const Key* hi, std::vector<Key>& out) const;
+    void diffRange(const MerkleAVLNode<Key, Value>* node, const MerkleAVLTree<Key, Value>& other,
+        const Key* lo, const Key* hi, std::vector<Key>& out) const;
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the MerkleAVLTree class.
+  --------------------------------------------------
+*/
+
+template<class Key, class Value>
+MerkleAVLTree<Key, Value>::MerkleAVLTree()
+{
+
+}
+
+/**
+* As AVLTree::merge; other's nodes already carry digests.
+*/
+template<class Key, class Value>
+void MerkleAVLTree<Key, Value>::merge(MerkleAVLTree<Key, Value>&& other)
+{
+  AVLTree<Key, Value>::merge(std::move(other));
+}
+
+/**
+* The digest of the whole tree, 0 when it is empty. Rehashes whatever
+* changed since the last call, so it needs the same exclusion as a write.
+*/
+template<class Key, class Value>
+uint64_t MerkleAVLTree<Key, Value>::digest() const
+{
+  refresh(root());
+  return digestOf(root());
+}
+
+/**
+* Marks node and its ancestors stale, stopping at the first ancestor that
+* already is: the ancestors of a stale node are always stale too.
+*/
+template<class Key, class Value>
+void MerkleAVLTree<Key, Value>::subtreeChanged(AVLNode<Key, Value>* node)
+{
+  static_cast<MerkleAVLNode<Key, Value>*>(node)->setStale(true);
+  for (node = node->getParent(); node != nullptr; node = node->getParent())
+  {
+    MerkleAVLNode<Key, Value>* ancestor = static_cast<MerkleAVLNode<Key, Value>*>(node);
+    if (ancestor->isStale())
+      break;
+    ancestor->setStale(true);
+  }
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* MerkleAVLTree<Key, Value>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) const
+{
+  return new MerkleAVLNode<Key, Value>(key, value, parent);
+}
+
+/**
+* Keeps the digest and stale flag, so that a copy put in node's place
+* (see AVLTree::relocate) leaves the digests above it valid.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* MerkleAVLTree<Key, Value>::copyNode(const AVLNode<Key, Value>& node, void* block) const
+{
+  const MerkleAVLNode<Key, Value>& from = static_cast<const MerkleAVLNode<Key, Value>&>(node);
+  MerkleAVLNode<Key, Value>* copy = (block == nullptr)
+      ? new MerkleAVLNode<Key, Value>(from.getKey(), from.getValue(), nullptr)
+      : new (block) MerkleAVLNode<Key, Value>(from.getKey(), from.getValue(), nullptr);
+  copy->setBalance(from.getBalance());
+  copy->setTombstone(from.isTombstone());
+  copy->setDigest(from.getDigest());
+  copy->setStale(from.isStale());
+  return copy;
+}
+
+template<class Key, class Value>
+size_t MerkleAVLTree<Key, Value>::nodeSize() const
+{
+  return sizeof(MerkleAVLNode<Key, Value>);
+}
+
+/**
+* The murmur3 64-bit finalizer.
+*/
+template<class Key, class Value>
+uint64_t MerkleAVLTree<Key, Value>::mix(uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/**
+* The hash of a node's own entry, 0 for a tombstone. The key's hash is
+* seeded first, as mix(0) is 0 and an entry (0, 0) would not count.
+*/
+template<class Key, class Value>
+uint64_t MerkleAVLTree<Key, Value>::entryHash(const MerkleAVLNode<Key, Value>* node)
+{
+  if (node->isTombstone())
+    return 0;
+  uint64_t keyHash = mix(static_cast<uint64_t>(std::hash<Key>()(node->getKey())) ^ 0x9e3779b97f4a7c15ULL);
+  return mix(keyHash + static_cast<uint64_t>(std::hash<Value>()(node->getValue())));
+}
+
+template<class Key, class Value>
+uint64_t MerkleAVLTree<Key, Value>::digestOf(const MerkleAVLNode<Key, Value>* node)
+{
+  return node == nullptr ? 0 : node->getDigest();
+}
+
+/**
+* Rehashes the stale nodes under node, children first.
+*/
+template<class Key, class Value>
+void MerkleAVLTree<Key, Value>::refresh(MerkleAVLNode<Key, Value>* node)
+{
+  if (node == nullptr || !node->isStale())
+    return;
+  MerkleAVLNode<Key, Value>* left = static_cast<MerkleAVLNode<Key, Value>*>(node->getLeft());
+  MerkleAVLNode<Key, Value>* right = static_cast<MerkleAVLNode<Key, Value>*>(node->getRight());
+  refresh(left);
+  refresh(right);
+  node->setDigest(digestOf(left) + entryHash(node) + digestOf(right));
+  node->setStale(false);
+}
+
+template<class Key, class Value>
+MerkleAVLNode<Key, Value>* MerkleAVLTree<Key, Value>::root() const
+{
+  return static_cast<MerkleAVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::root_);
+}
+
+/**
+* The digest of the entries with keys below bound (up to and including it
+* if inclusive), or of all entries if bound is nullptr. The tree must have
+* been refreshed.
+*/
+template<class Key, class Value>
+uint64_t MerkleAVLTree<Key, Value>::digestBelow(const Key* bound, bool inclusive) const
+{
+  if (bound == nullptr)
+    return digestOf(root());
+  uint64_t sum = 0;
+  const MerkleAVLNode<Key, Value>* currNode = root();
+  while (currNode != nullptr)
+  {
+    const Key& key = currNode->getKey();
+    if (key < *bound || (inclusive && key == *bound))
+    {
+      sum += digestOf(static_cast<MerkleAVLNode<Key, Value>*>(currNode->getLeft())) + entryHash(currNode);
+      currNode = static_cast<MerkleAVLNode<Key, Value>*>(currNode->getRight());
+    }
+    else
+    {
+      currNode = static_cast<MerkleAVLNode<Key, Value>*>(currNode->getLeft());
+    }
+  }
+  return sum;
+}
+
+/**
+* The digest of the entries strictly between lo and hi, where nullptr
+* leaves that side open.
+*/
+template<class Key, class Value>
+uint64_t MerkleAVLTree<Key, Value>::rangeDigest(const Key* lo, const Key* hi) const
+{
+  return digestBelow(hi, false) - (lo == nullptr ? 0 : digestBelow(lo, true));
+}
+
+/**
+* The node holding key if it is live, otherwise nullptr.
+*/
+template<class Key, class Value>
+const MerkleAVLNode<Key, Value>* MerkleAVLTree<Key, Value>::liveNode(const Key& key) const
+{
+  const MerkleAVLNode<Key, Value>* currNode = root();
+  while (currNode != nullptr && !(currNode->getKey() == key))
+  {
+    if (key < currNode->getKey())
+      currNode = static_cast<MerkleAVLNode<Key, Value>*>(currNode->getLeft());
+    else
+      currNode = static_cast<MerkleAVLNode<Key, Value>*>(currNode->getRight());
+  }
+  return (currNode == nullptr || currNode->isTombstone()) ? nullptr : currNode;
+}
+
+/**
+* Appends the keys of the live entries strictly between lo and hi.
+*/
+template<class Key, class Value>
+void MerkleAVLTree<Key, Value>::collectRange(const Key* lo, const Key* hi, std::vector<Key>& out) const
+{
+  //first node above lo
+  Node<Key, Value>* first = nullptr;
+  Node<Key, Value>* currNode = root();
+  while (currNode != nullptr)
+  {
+    if (lo == nullptr || *lo < currNode->getKey())
+    {
+      first = currNode;
+      currNode = currNode->getLeft();
+    }
+    else
+    {
+      currNode = currNode->getRight();
+    }
+  }
+  for (currNode = first; currNode != nullptr; currNode = this->successor(currNode))
+  {
+    if (hi != nullptr && !(currNode->getKey() < *hi))
+      break;
+    if (!currNode->isTombstone())
+      out.push_back(currNode->getKey());
+  }
+}
+
+/**
+* Compares the subtree at node, whose keys lie strictly between lo and hi,
+* with the same key range of other, and appends the keys that differ in
+* order. A range whose digests agree is skipped; otherwise node's own entry
+* is compared and the range is split at its key.
+*/
+template<class Key, class Value>
+void MerkleAVLTree<Key, Value>::diffRange(const MerkleAVLNode<Key, Value>* node, const MerkleAVLTree<Key, Value>& other,
+    const Key* lo, const Key* hi, std::vector<Key>& out) const
+{
+  if (digestOf(node) == other.rangeDigest(lo, hi))
+    return;
+  if (node == nullptr)
+  {
+    other.collectRange(lo, hi, out);
+    return;
+  }
+  const Key& key = node->getKey();
+  diffRange(static_cast<MerkleAVLNode<Key, Value>*>(node->getLeft()), other, lo, &key, out);
+  const MerkleAVLNode<Key, Value>* match = other.liveNode(key);
+  if (node->isTombstone() ? match != nullptr : (match == nullptr || !(match->getValue() == node->getValue())))
+  {
+    out.push_back(key);
+  }
+  diffRange(static_cast<MerkleAVLNode<Key, Value>*>(node->getRight()), other, &key, hi, out);
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the MerkleAVLTree class.
+  ------------------------------------------------
+*/
+
+/**
+* Returns, in order, every key whose entry differs between a and b: present
+* in only one of them, or with different values. Only subtrees of a whose
+* digest differs from that of the same key range in b are visited, so
+* nearly identical trees compare in O(d log^2 n) for d differences.
+*/
+template <class Key, class Value>
+std::vector<Key> diff(const MerkleAVLTree<Key, Value>& a, const MerkleAVLTree<Key, Value>& b)
+{
+  std::vector<Key> out;
+  a.digest();
+  b.digest();
+  a.diffRange(a.root(), b, nullptr, nullptr, out);
+  return out;
+}
+
+#endif
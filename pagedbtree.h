@@ -0,0 +1,696 @@
+#ifndef PAGEDBTREE_H
+#define PAGEDBTREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include "bufferpool.h"
+
+/**
+* A B+ tree kept in a file of fixed-size pages and cached by a BufferPool,
+* so that the index can be far larger than the memory given to it. It has
+* the find / insert / remove / iterator interface of BinarySearchTree.
+*
+* Page 0 holds the metadata; every other page is a node. A leaf holds up
+* to maxLeaf sorted keys and their values and links to its right sibling;
+* an internal node holds up to maxInner separator keys and one more child
+* page, where a separator is the smallest key of the child to its right.
+*
+* Concurrency uses page latches. Readers hold shared latches, releasing a
+* parent once the child is latched. Inserts hold exclusive latches and
+* split every full node on the way down, so a split never has to go back
+* up: at most a parent and a child are latched at once. Every operation
+* takes a BufferPool::Admission for the pages it pins at once, so that
+* concurrent descents cannot pin every frame and wait on each other; with
+* the minimum of 16 frames, four inserts run together. Removes take the
+* leaf exclusively and, as in many disk B-trees, do not merge underfull
+* pages; an emptied leaf stays linked and is skipped by iteration.
+*
+* Iterators hold a copy of the current entry, not a reference into a
+* page, and ++ seeks past the current key if the leaf changed meanwhile.
+* Changes reach the file when pages are evicted, on flush() and on
+* destruction; there is no protection against a crash in between.
+* Key and Value must be trivially copyable.
+*/
+template <typename Key, typename Value>
+class PagedBTree
+{
+public:
+    typedef std::pair<Key, Value> item_type;
+
+    static const size_t DEFAULT_PAGE_SIZE = 4096;
+
+    PagedBTree(const std::string& path, size_t cacheBytes, size_t pageSize = DEFAULT_PAGE_SIZE);
+    ~PagedBTree();
+    PagedBTree(const PagedBTree&) = delete;
+    PagedBTree& operator=(const PagedBTree&) = delete;
+
+    /**
+    * An iterator over the entries in key order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const item_type& operator*() const;
+        const item_type* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PagedBTree<Key, Value>;
+        iterator(const PagedBTree<Key, Value>* tree, uint32_t leaf, uint16_t index, const item_type& item);
+
+        const PagedBTree<Key, Value>* tree_;
+        uint32_t leaf_;     // 0 for end()
+        uint16_t index_;
+        item_type item_;
+    };
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void flush();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    const Value operator[](const Key& key) const;
+
+    bool empty() const;
+    size_t size() const;
+    const BufferPool& pool() const;
+
+protected:
+    struct Meta
+    {
+        char magic[8];        // "AVLBTRE\0"
+        uint32_t pageSize;
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t root;
+        uint64_t size;
+    };
+    struct NodeHeader
+    {
+        uint16_t leaf;
+        uint16_t count;
+        uint32_t next;        // right sibling of a leaf, 0 for none
+    };
+    typedef BufferPool::PageRef PageRef;
+
+    static size_t alignUp(size_t offset, size_t alignment);
+    void computeLayout();
+    void format();
+
+    static NodeHeader* header(const PageRef& page);
+    Key* keys(const PageRef& page) const;
+    Value* values(const PageRef& page) const;
+    uint32_t* children(const PageRef& page) const;
+    bool isFull(const PageRef& page) const;
+    uint32_t childIndex(const PageRef& page, const Key& key) const;
+    PageRef splitChild(PageRef& parent, uint32_t index, PageRef& child);
+    PageRef descendShared(const Key* key, bool exclusiveLeaf) const;
+    iterator seek(const Key* key, bool after) const;
+
+    // the most pages an operation pins at once: an insert growing a new
+    // root holds the meta page, the old root, the new root and its sibling
+    static const size_t MAX_PINS = 4;
+    static const size_t READ_PINS = 2;
+
+    mutable BufferPool pool_;
+    size_t keysOffset_;
+    size_t valuesOffset_;
+    size_t childrenOffset_;
+    size_t maxLeaf_;
+    size_t maxInner_;
+    std::atomic<size_t> size_;
+
+    static_assert(std::is_trivially_copyable<Key>::value, "paged keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "paged values must be trivially copyable");
+};
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the PagedBTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<typename Key, typename Value>
+PagedBTree<Key, Value>::iterator::iterator() :
+    tree_(nullptr), leaf_(0), index_(0), item_()
+{
+
+}
+
+template<typename Key, typename Value>
+PagedBTree<Key, Value>::iterator::iterator(const PagedBTree<Key, Value>* tree, uint32_t leaf, uint16_t index,
+    const item_type& item) :
+    tree_(tree), leaf_(leaf), index_(index), item_(item)
+{
+
+}
+
+template<typename Key, typename Value>
+const typename PagedBTree<Key, Value>::item_type& PagedBTree<Key, Value>::iterator::operator*() const
+{
+  return item_;
+}
+
+template<typename Key, typename Value>
+const typename PagedBTree<Key, Value>::item_type* PagedBTree<Key, Value>::iterator::operator->() const
+{
+  return &item_;
+}
+
+/**
+* Iterators are equal if both are end() or both are at the same key.
+*/
+template<typename Key, typename Value>
+bool PagedBTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+  if (leaf_ == 0 || rhs.leaf_ == 0)
+  {
+    return leaf_ == rhs.leaf_;
+  }
+  return item_.first == rhs.item_.first;
+}
+
+template<typename Key, typename Value>
+bool PagedBTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+  return !(*this == rhs);
+}
+
+/**
+* Advances to the next key. If the leaf still has the current key where
+* it was, the next slot is read directly; otherwise the tree is searched
+* again for the first key after it.
+*/
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::iterator& PagedBTree<Key, Value>::iterator::operator++()
+{
+  {
+    BufferPool::Admission admission(tree_->pool_, 1);
+    PageRef page = tree_->pool_.fetch(leaf_);
+    page.latchShared();
+    NodeHeader* node = header(page);
+    if (node->leaf && index_ + 1u < node->count && tree_->keys(page)[index_] == item_.first)
+    {
+      index_++;
+      item_ = item_type(tree_->keys(page)[index_], tree_->values(page)[index_]);
+      return *this;
+    }
+  }
+  *this = tree_->seek(&item_.first, true);
+  return *this;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the PagedBTree::iterator class.
+  -------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the PagedBTree class.
+  -----------------------------------------------
+*/
+
+/**
+* Opens the tree in the file at path, creating it if the file is empty,
+* with cacheBytes of buffer pool (at least 16 pages). Throws
+* std::runtime_error if the file holds a tree of another layout.
+*/
+template<typename Key, typename Value>
+PagedBTree<Key, Value>::PagedBTree(const std::string& path, size_t cacheBytes, size_t pageSize) :
+    pool_(path, pageSize, std::max(cacheBytes / pageSize, static_cast<size_t>(16))), size_(0)
+{
+  computeLayout();
+  if (pool_.pageCount() == 0)
+  {
+    format();
+    return;
+  }
+  PageRef metaPage = pool_.fetch(0);
+  const Meta* meta = reinterpret_cast<const Meta*>(metaPage.data());
+  if (std::memcmp(meta->magic, "AVLBTRE", 8) != 0 || meta->pageSize != pageSize
+      || meta->keySize != sizeof(Key) || meta->valueSize != sizeof(Value))
+  {
+    throw std::runtime_error(path + " is not a compatible paged tree");
+  }
+  size_ = meta->size;
+}
+
+/**
+* Records the size and writes every dirty page back.
+*/
+template<typename Key, typename Value>
+PagedBTree<Key, Value>::~PagedBTree()
+{
+  try
+  {
+    flush();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "PagedBTree: final flush failed: " << e.what() << std::endl;
+  }
+}
+
+/**
+* If key is already in the tree, the current value is overwritten.
+*/
+template<typename Key, typename Value>
+void PagedBTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  const Key& key = keyValuePair.first;
+  BufferPool::Admission admission(pool_, MAX_PINS);
+  PageRef metaPage = pool_.fetch(0);
+  metaPage.latchExclusive();
+  Meta* meta = reinterpret_cast<Meta*>(metaPage.data());
+  PageRef node = pool_.fetch(meta->root);
+  node.latchExclusive();
+  if (isFull(node))
+  {
+    //grow a new root above the full one
+    PageRef root = pool_.allocate();
+    root.latchExclusive();
+    NodeHeader* rootHeader = header(root);
+    rootHeader->leaf = 0;
+    rootHeader->count = 0;
+    children(root)[0] = node.id();
+    root.markDirty();
+    PageRef sibling = splitChild(root, 0, node);
+    sibling.release();
+    node.release();
+    meta->root = root.id();
+    metaPage.markDirty();
+    node = std::move(root);
+  }
+  metaPage.release();
+
+  while (!header(node)->leaf)
+  {
+    uint32_t index = childIndex(node, key);
+    PageRef child = pool_.fetch(children(node)[index]);
+    child.latchExclusive();
+    if (isFull(child))
+    {
+      PageRef sibling = splitChild(node, index, child);
+      if (!(key < keys(node)[index]))
+      {
+        child = std::move(sibling);
+      }
+    }
+    node = std::move(child);
+  }
+
+  NodeHeader* leaf = header(node);
+  Key* leafKeys = keys(node);
+  Value* leafValues = values(node);
+  uint32_t pos = std::lower_bound(leafKeys, leafKeys + leaf->count, key) - leafKeys;
+  if (pos < leaf->count && leafKeys[pos] == key)
+  {
+    leafValues[pos] = keyValuePair.second;
+  }
+  else
+  {
+    std::memmove(leafKeys + pos + 1, leafKeys + pos, (leaf->count - pos) * sizeof(Key));
+    std::memmove(leafValues + pos + 1, leafValues + pos, (leaf->count - pos) * sizeof(Value));
+    leafKeys[pos] = key;
+    leafValues[pos] = keyValuePair.second;
+    leaf->count++;
+    size_++;
+  }
+  node.markDirty();
+}
+
+/**
+* Removes the key if it exists. Only its leaf changes.
+*/
+template<typename Key, typename Value>
+void PagedBTree<Key, Value>::remove(const Key& key)
+{
+  BufferPool::Admission admission(pool_, READ_PINS);
+  PageRef node = descendShared(&key, true);
+  NodeHeader* leaf = header(node);
+  Key* leafKeys = keys(node);
+  Value* leafValues = values(node);
+  uint32_t pos = std::lower_bound(leafKeys, leafKeys + leaf->count, key) - leafKeys;
+  if (pos == leaf->count || !(leafKeys[pos] == key))
+  {
+    return;
+  }
+  std::memmove(leafKeys + pos, leafKeys + pos + 1, (leaf->count - pos - 1) * sizeof(Key));
+  std::memmove(leafValues + pos, leafValues + pos + 1, (leaf->count - pos - 1) * sizeof(Value));
+  leaf->count--;
+  size_--;
+  node.markDirty();
+}
+
+/**
+* Removes every entry and shrinks the file to an empty tree. Nothing else
+* may use the tree meanwhile.
+*/
+template<typename Key, typename Value>
+void PagedBTree<Key, Value>::clear()
+{
+  pool_.truncate();
+  format();
+}
+
+/**
+* Writes every dirty page back and syncs the file. Nothing else may
+* change the tree meanwhile.
+*/
+template<typename Key, typename Value>
+void PagedBTree<Key, Value>::flush()
+{
+  {
+    BufferPool::Admission admission(pool_, 1);
+    PageRef metaPage = pool_.fetch(0);
+    metaPage.latchExclusive();
+    reinterpret_cast<Meta*>(metaPage.data())->size = size_;
+    metaPage.markDirty();
+  }
+  pool_.flushAll();
+}
+
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::iterator PagedBTree<Key, Value>::begin() const
+{
+  return seek(nullptr, false);
+}
+
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::iterator PagedBTree<Key, Value>::end() const
+{
+  return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::iterator PagedBTree<Key, Value>::find(const Key& key) const
+{
+  iterator it = seek(&key, false);
+  if (it != end() && it->first == key)
+  {
+    return it;
+  }
+  return end();
+}
+
+/**
+* Returns an iterator to the first item whose key is not below key.
+*/
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::iterator PagedBTree<Key, Value>::lowerBound(const Key& key) const
+{
+  return seek(&key, false);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns a copy of the value associated with the key; the value lives
+ * in a page that may be evicted, so no reference is handed out. The copy
+ * is const so that tree[key] = value does not compile, since it would
+ * only change the copy; use insert.
+ */
+template<typename Key, typename Value>
+const Value PagedBTree<Key, Value>::operator[](const Key& key) const
+{
+  iterator it = find(key);
+  if(it == end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+
+template<typename Key, typename Value>
+bool PagedBTree<Key, Value>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename Key, typename Value>
+size_t PagedBTree<Key, Value>::size() const
+{
+  return size_;
+}
+
+/**
+* The buffer pool, for its hit, miss and write counts.
+*/
+template<typename Key, typename Value>
+const BufferPool& PagedBTree<Key, Value>::pool() const
+{
+  return pool_;
+}
+
+template<typename Key, typename Value>
+size_t PagedBTree<Key, Value>::alignUp(size_t offset, size_t alignment)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+/**
+* Works out where keys, values and child ids go in a page and how many
+* of each fit.
+*/
+template<typename Key, typename Value>
+void PagedBTree<Key, Value>::computeLayout()
+{
+  size_t pageSize = pool_.pageSize();
+  keysOffset_ = alignUp(sizeof(NodeHeader), alignof(Key));
+  maxLeaf_ = (pageSize - keysOffset_) / (sizeof(Key) + sizeof(Value));
+  while (maxLeaf_ > 0 && alignUp(keysOffset_ + maxLeaf_ * sizeof(Key), alignof(Value))
+         + maxLeaf_ * sizeof(Value) > pageSize)
+  {
+    maxLeaf_--;
+  }
+  maxInner_ = (pageSize - keysOffset_ - sizeof(uint32_t)) / (sizeof(Key) + sizeof(uint32_t));
+  while (maxInner_ > 0 && alignUp(keysOffset_ + maxInner_ * sizeof(Key), alignof(uint32_t))
+         + (maxInner_ + 1) * sizeof(uint32_t) > pageSize)
+  {
+    maxInner_--;
+  }
+  //counts are 16 bits
+  maxLeaf_ = std::min(maxLeaf_, static_cast<size_t>(UINT16_MAX));
+  maxInner_ = std::min(maxInner_, static_cast<size_t>(UINT16_MAX - 1));
+  if (maxLeaf_ < 3 || maxInner_ < 3 || sizeof(Meta) > pageSize)
+  {
+    throw std::runtime_error("pages are too small for these keys and values");
+  }
+  valuesOffset_ = alignUp(keysOffset_ + maxLeaf_ * sizeof(Key), alignof(Value));
+  childrenOffset_ = alignUp(keysOffset_ + maxInner_ * sizeof(Key), alignof(uint32_t));
+}
+
+/**
+* Writes the metadata page and an empty root leaf.
+*/
+template<typename Key, typename Value>
+void PagedBTree<Key, Value>::format()
+{
+  PageRef metaPage = pool_.allocate();
+  PageRef root = pool_.allocate();
+  Meta* meta = reinterpret_cast<Meta*>(metaPage.data());
+  std::memcpy(meta->magic, "AVLBTRE", 8);
+  meta->pageSize = pool_.pageSize();
+  meta->keySize = sizeof(Key);
+  meta->valueSize = sizeof(Value);
+  meta->root = root.id();
+  meta->size = 0;
+  header(root)->leaf = 1;
+  metaPage.markDirty();
+  root.markDirty();
+  size_ = 0;
+}
+
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::NodeHeader* PagedBTree<Key, Value>::header(const PageRef& page)
+{
+  return reinterpret_cast<NodeHeader*>(page.data());
+}
+
+template<typename Key, typename Value>
+Key* PagedBTree<Key, Value>::keys(const PageRef& page) const
+{
+  return reinterpret_cast<Key*>(page.data() + keysOffset_);
+}
+
+template<typename Key, typename Value>
+Value* PagedBTree<Key, Value>::values(const PageRef& page) const
+{
+  return reinterpret_cast<Value*>(page.data() + valuesOffset_);
+}
+
+template<typename Key, typename Value>
+uint32_t* PagedBTree<Key, Value>::children(const PageRef& page) const
+{
+  return reinterpret_cast<uint32_t*>(page.data() + childrenOffset_);
+}
+
+template<typename Key, typename Value>
+bool PagedBTree<Key, Value>::isFull(const PageRef& page) const
+{
+  NodeHeader* node = header(page);
+  return node->count == (node->leaf ? maxLeaf_ : maxInner_);
+}
+
+/**
+* The child of an internal node whose subtree holds key.
+*/
+template<typename Key, typename Value>
+uint32_t PagedBTree<Key, Value>::childIndex(const PageRef& page, const Key& key) const
+{
+  const Key* nodeKeys = keys(page);
+  return std::upper_bound(nodeKeys, nodeKeys + header(page)->count, key) - nodeKeys;
+}
+
+/**
+* Splits the full child at index of parent, which is latched exclusively
+* and not full, into child and a new right sibling, and adds the
+* separator to parent. Returns the sibling, latched exclusively.
+*/
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::PageRef
+PagedBTree<Key, Value>::splitChild(PageRef& parent, uint32_t index, PageRef& child)
+{
+  PageRef sibling = pool_.allocate();
+  sibling.latchExclusive();
+  NodeHeader* childHeader = header(child);
+  NodeHeader* siblingHeader = header(sibling);
+  Key separator;
+  if (childHeader->leaf)
+  {
+    uint16_t half = childHeader->count / 2;
+    uint16_t moved = childHeader->count - half;
+    siblingHeader->leaf = 1;
+    siblingHeader->count = moved;
+    siblingHeader->next = childHeader->next;
+    childHeader->next = sibling.id();
+    std::memcpy(keys(sibling), keys(child) + half, moved * sizeof(Key));
+    std::memcpy(values(sibling), values(child) + half, moved * sizeof(Value));
+    childHeader->count = half;
+    separator = keys(sibling)[0];
+  }
+  else
+  {
+    //the middle key moves up rather than being copied
+    uint16_t mid = childHeader->count / 2;
+    uint16_t moved = childHeader->count - mid - 1;
+    separator = keys(child)[mid];
+    siblingHeader->leaf = 0;
+    siblingHeader->count = moved;
+    std::memcpy(keys(sibling), keys(child) + mid + 1, moved * sizeof(Key));
+    std::memcpy(children(sibling), children(child) + mid + 1, (moved + 1) * sizeof(uint32_t));
+    childHeader->count = mid;
+  }
+
+  NodeHeader* parentHeader = header(parent);
+  Key* parentKeys = keys(parent);
+  uint32_t* parentChildren = children(parent);
+  std::memmove(parentKeys + index + 1, parentKeys + index, (parentHeader->count - index) * sizeof(Key));
+  std::memmove(parentChildren + index + 2, parentChildren + index + 1,
+      (parentHeader->count - index) * sizeof(uint32_t));
+  parentKeys[index] = separator;
+  parentChildren[index + 1] = sibling.id();
+  parentHeader->count++;
+
+  parent.markDirty();
+  child.markDirty();
+  sibling.markDirty();
+  return sibling;
+}
+
+/**
+* Descends to the leaf for key (the leftmost leaf if key is nullptr),
+* latching each node shared before letting go of its parent, and returns
+* the leaf latched shared, or exclusively if exclusiveLeaf.
+*/
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::PageRef PagedBTree<Key, Value>::descendShared(const Key* key, bool exclusiveLeaf) const
+{
+  PageRef parent = pool_.fetch(0);
+  parent.latchShared();
+  uint32_t pageId = reinterpret_cast<const Meta*>(parent.data())->root;
+  while (true)
+  {
+    PageRef node = pool_.fetch(pageId);
+    node.latchShared();
+    if (header(node)->leaf && exclusiveLeaf)
+    {
+      //a leaf cannot be split while its parent is latched shared
+      node.release();
+      node = pool_.fetch(pageId);
+      node.latchExclusive();
+    }
+    parent = std::move(node);
+    if (header(parent)->leaf)
+    {
+      return parent;
+    }
+    pageId = children(parent)[key == nullptr ? 0 : childIndex(parent, *key)];
+  }
+}
+
+/**
+* Returns an iterator to the first key at or after key (strictly after it
+* if after is set), or to the first key if key is nullptr. Emptied leaves
+* are skipped along the sibling links, latching each sibling before
+* letting go of the leaf before it.
+*/
+template<typename Key, typename Value>
+typename PagedBTree<Key, Value>::iterator PagedBTree<Key, Value>::seek(const Key* key, bool after) const
+{
+  BufferPool::Admission admission(pool_, READ_PINS);
+  PageRef leaf = descendShared(key, false);
+  uint32_t pos = 0;
+  if (key != nullptr)
+  {
+    const Key* leafKeys = keys(leaf);
+    uint16_t count = header(leaf)->count;
+    pos = (after ? std::upper_bound(leafKeys, leafKeys + count, *key)
+                 : std::lower_bound(leafKeys, leafKeys + count, *key)) - leafKeys;
+  }
+  while (pos >= header(leaf)->count)
+  {
+    uint32_t next = header(leaf)->next;
+    if (next == 0)
+    {
+      return end();
+    }
+    PageRef sibling = pool_.fetch(next);
+    sibling.latchShared();
+    leaf = std::move(sibling);
+    pos = 0;
+  }
+  return iterator(this, leaf.id(), pos, item_type(keys(leaf)[pos], values(leaf)[pos]));
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the PagedBTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+
+/**
+* A node for a red-black tree. Like AVLNode, the extra per-node state (the
+* color) lives in the tag bits of the parent pointer, so an RBNode is the
+* same size as a plain Node. New nodes start red.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    enum Color { RED = 0, BLACK = 1 };
+
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+    virtual RBNode<Key, Value>* clone() const override;
+
+    Color getColor() const;
+    void setColor(Color color);
+
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------
+*/
+
+/**
+* An explicit constructor to initialize the elements by calling the base class constructor
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent)
+{
+    setColor(RED);
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+/**
+* Returns an unlinked copy, keeping the color.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::clone() const
+{
+    RBNode<Key, Value>* copy = new RBNode<Key, Value>(this->getKey(), this->getValue(), nullptr);
+    copy->copyStateFrom(*this);
+    return copy;
+}
+
+/**
+* A getter for the color of an RBNode.
+*/
+template<class Key, class Value>
+typename RBNode<Key, Value>::Color RBNode<Key, Value>::getColor() const
+{
+    return static_cast<Color>(this->getTag());
+}
+
+/**
+* A setter for the color of an RBNode.
+*/
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(Color color)
+{
+    this->setTag(static_cast<uintptr_t>(color));
+}
+
+/**
+* An overridden function for getting the parent since a static_cast is necessary to make sure
+* that our node is an RBNode.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getLeft());
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getRight());
+}
+
+/*
+  -----------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------
+*/
+
+/**
+* A red-black tree. Insert does at most two rotations and remove at most
+* three; all other rebalancing is recoloring, which makes it cheaper than
+* AVLTree for write-heavy loads at the price of a looser height bound
+* (2 log n rather than about 1.44 log n).
+*/
+template <class Key, class Value>
+class RBTree : public BinarySearchTree<Key, Value>
+{
+public:
+    virtual void insert (const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    bool isValidRB() const;
+protected:
+    virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) override;
+
+    // Add helper functions here
+    static bool isRed(RBNode<Key, Value>* node);
+    void insertFixup(RBNode<Key, Value>* node);
+    void removeFixup(RBNode<Key, Value>* node);
+    int blackHeightHelper(RBNode<Key, Value>* node) const;
+};
+
+/*
+ * If key is already in the tree, the current value is overwritten.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+{
+  RBNode<Key, Value>* prevNode = nullptr;
+  RBNode<Key, Value>* currNode = static_cast<RBNode<Key, Value>*>(this->root_);
+  while (currNode != nullptr)
+  {
+    if (currNode->getKey() == new_item.first)
+    {
+      currNode->setValue(new_item.second);
+      return;
+    }
+    prevNode = currNode;
+    if (currNode->getKey() > new_item.first)
+    {
+      currNode = currNode->getLeft();
+    }
+    else
+    {
+      currNode = currNode->getRight();
+    }
+  }
+  RBNode<Key, Value>* temp = new RBNode<Key, Value>(new_item.first, new_item.second, prevNode);
+  if (prevNode == nullptr)
+  {
+    this->root_ = temp;
+  }
+  else if (prevNode->getKey() > new_item.first)
+  {
+    prevNode->setLeft(temp);
+  }
+  else
+  {
+    prevNode->setRight(temp);
+  }
+  insertFixup(temp);
+}
+
+/*
+ * As in the other trees, a node with 2 children is first swapped with its
+ * predecessor. The double-black fixup then runs while the node is still
+ * linked in, so removeHelp can unlink it afterwards as usual.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::remove(const Key& key)
+{
+  RBNode<Key, Value>* currNode = static_cast<RBNode<Key, Value>*>(this->internalFind(key));
+  if (currNode == nullptr)
+  {
+    return;
+  }
+  if (currNode->getLeft() != nullptr && currNode->getRight() != nullptr)
+  {
+    nodeSwap(currNode, this->predecessor(currNode));
+  }
+  RBNode<Key, Value>* child = (currNode->getLeft() != nullptr) ? currNode->getLeft() : currNode->getRight();
+  if (!isRed(currNode))
+  {
+    if (isRed(child))
+    {
+      //a black node with one child always has a red leaf child
+      child->setColor(RBNode<Key, Value>::BLACK);
+    }
+    else
+    {
+      removeFixup(currNode);
+    }
+  }
+  this->removeHelp(currNode);
+}
+
+/**
+ * Return true if the tree satisfies the red-black properties: a black root,
+ * no red node with a red child and equal black height on every path.
+ */
+template<class Key, class Value>
+bool RBTree<Key, Value>::isValidRB() const
+{
+  RBNode<Key, Value>* root = static_cast<RBNode<Key, Value>*>(this->root_);
+  if (isRed(root))
+  {
+    return false;
+  }
+  return blackHeightHelper(root) != -1;
+}
+
+/**
+* Swaps positions and, with them, colors.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+{
+  BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+  RBNode<Key, Value>* r1 = static_cast<RBNode<Key, Value>*>(n1);
+  RBNode<Key, Value>* r2 = static_cast<RBNode<Key, Value>*>(n2);
+  typename RBNode<Key, Value>::Color tempC = r1->getColor();
+  r1->setColor(r2->getColor());
+  r2->setColor(tempC);
+}
+
+/**
+* nullptr leaves count as black.
+*/
+template<class Key, class Value>
+bool RBTree<Key, Value>::isRed(RBNode<Key, Value>* node)
+{
+  return node != nullptr && node->getColor() == RBNode<Key, Value>::RED;
+}
+
+/**
+* Restores the red-black properties after node was inserted red.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::insertFixup(RBNode<Key, Value>* node)
+{
+  while (isRed(node->getParent()))
+  {
+    RBNode<Key, Value>* parent = node->getParent();
+    RBNode<Key, Value>* grandParent = parent->getParent(); // exists, the root is black
+    bool parentIsLeft = (parent == grandParent->getLeft());
+    RBNode<Key, Value>* uncle = parentIsLeft ? grandParent->getRight() : grandParent->getLeft();
+
+    if (isRed(uncle))
+    {
+      //recolor and continue from the grandparent
+      parent->setColor(RBNode<Key, Value>::BLACK);
+      uncle->setColor(RBNode<Key, Value>::BLACK);
+      grandParent->setColor(RBNode<Key, Value>::RED);
+      node = grandParent;
+      continue;
+    }
+    if (parentIsLeft)
+    {
+      if (node == parent->getRight())
+      {
+        this->rotateLeft(parent);
+        parent = node;
+      }
+      this->rotateRight(grandParent);
+    }
+    else
+    {
+      if (node == parent->getLeft())
+      {
+        this->rotateRight(parent);
+        parent = node;
+      }
+      this->rotateLeft(grandParent);
+    }
+    parent->setColor(RBNode<Key, Value>::BLACK);
+    grandParent->setColor(RBNode<Key, Value>::RED);
+    break;
+  }
+  static_cast<RBNode<Key, Value>*>(this->root_)->setColor(RBNode<Key, Value>::BLACK);
+}
+
+/**
+* Fixes the missing black on node's path, where node is a black node
+* about to be unlinked.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::removeFixup(RBNode<Key, Value>* node)
+{
+  while (node != this->root_ && !isRed(node))
+  {
+    RBNode<Key, Value>* parent = node->getParent();
+    bool nodeIsLeft = (node == parent->getLeft());
+    // the sibling exists: node's side has a black height of at least one
+    RBNode<Key, Value>* sibling = nodeIsLeft ? parent->getRight() : parent->getLeft();
+
+    if (isRed(sibling))
+    {
+      sibling->setColor(RBNode<Key, Value>::BLACK);
+      parent->setColor(RBNode<Key, Value>::RED);
+      if (nodeIsLeft)
+      {
+        this->rotateLeft(parent);
+        sibling = parent->getRight();
+      }
+      else
+      {
+        this->rotateRight(parent);
+        sibling = parent->getLeft();
+      }
+    }
+
+    RBNode<Key, Value>* nearNephew = nodeIsLeft ? sibling->getLeft() : sibling->getRight();
+    RBNode<Key, Value>* farNephew = nodeIsLeft ? sibling->getRight() : sibling->getLeft();
+    if (!isRed(nearNephew) && !isRed(farNephew))
+    {
+      //push the missing black up a level
+      sibling->setColor(RBNode<Key, Value>::RED);
+      node = parent;
+      continue;
+    }
+    if (!isRed(farNephew))
+    {
+      nearNephew->setColor(RBNode<Key, Value>::BLACK);
+      sibling->setColor(RBNode<Key, Value>::RED);
+      if (nodeIsLeft)
+      {
+        this->rotateRight(sibling);
+      }
+      else
+      {
+        this->rotateLeft(sibling);
+      }
+      farNephew = sibling;
+      sibling = nearNephew;
+    }
+    sibling->setColor(parent->getColor());
+    parent->setColor(RBNode<Key, Value>::BLACK);
+    farNephew->setColor(RBNode<Key, Value>::BLACK);
+    if (nodeIsLeft)
+    {
+      this->rotateLeft(parent);
+    }
+    else
+    {
+      this->rotateRight(parent);
+    }
+    break;
+  }
+  node->setColor(RBNode<Key, Value>::BLACK);
+}
+
+/**
+* Returns the black height of the subtree, or -1 if it violates a property.
+*/
+template<class Key, class Value>
+int RBTree<Key, Value>::blackHeightHelper(RBNode<Key, Value>* node) const
+{
+  if (node == nullptr)
+  {
+    return 1;
+  }
+  if (isRed(node) && (isRed(node->getLeft()) || isRed(node->getRight())))
+  {
+    return -1;
+  }
+  int leftHeight = blackHeightHelper(node->getLeft());
+  int rightHeight = blackHeightHelper(node->getRight());
+  if (leftHeight == -1 || leftHeight != rightHeight)
+  {
+    return -1;
+  }
+  return leftHeight + (isRed(node) ? 0 : 1);
+}
+
+#endif
@@ -0,0 +1,905 @@
+#ifndef SHAREDAVL_H
+#define SHAREDAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+* A pointer stored as the distance from its own address to the target, so
+* that a structure built from them means the same thing wherever the
+* region holding it is mapped. A distance of 0 is nullptr (nothing links
+* to itself). OffsetPtrs are never copied; they are only set and read.
+*/
+template <typename T>
+class OffsetPtr
+{
+public:
+    OffsetPtr() : offset_(0) { }
+    OffsetPtr(const OffsetPtr&) = delete;
+    OffsetPtr& operator=(const OffsetPtr&) = delete;
+
+    T* get() const;
+    void set(T* target);
+    uintptr_t address() const;
+
+protected:
+    int64_t offset_;
+};
+
+template<typename T>
+T* OffsetPtr<T>::get() const
+{
+  return reinterpret_cast<T*>(address());
+}
+
+template<typename T>
+void OffsetPtr<T>::set(T* target)
+{
+  offset_ = (target == nullptr) ? 0
+      : static_cast<int64_t>(reinterpret_cast<uintptr_t>(target) - reinterpret_cast<uintptr_t>(this));
+}
+
+/**
+* The target address as an integer, or 0 for nullptr. Readers racing a
+* writer use this to bounds-check a link before following it.
+*/
+template<typename T>
+uintptr_t OffsetPtr<T>::address() const
+{
+  return (offset_ == 0) ? 0 : reinterpret_cast<uintptr_t>(this) + static_cast<uintptr_t>(offset_);
+}
+
+/**
+* A node of a SharedAVLTree. It lives in the mapped region, so it holds
+* offset links and no virtual functions.
+*/
+template <typename Key, typename Value>
+struct SharedAVLNode
+{
+    OffsetPtr<SharedAVLNode> parent_;
+    OffsetPtr<SharedAVLNode> left_;
+    OffsetPtr<SharedAVLNode> right_;
+    int8_t balance_;
+    Key key_;
+    Value value_;
+};
+
+/**
+* An AVL tree kept in a fixed-capacity, memory-mapped region (a file, or a
+* POSIX shared memory object) so that several processes on a host can
+* share one copy. Nodes link to each other by self-relative offsets.
+*
+* One process creates the region and is the only writer; any number of
+* processes attach to it read-only and search it in place. Every write is
+* bracketed by a version counter in the region (odd while a write is in
+* progress). lookup() reads optimistically and retries if the version was
+* odd or moved, so readers never block the writer and never see a torn
+* result. Links are bounds-checked before they are followed, so a reader
+* that races a rotation retries rather than leaving the region.
+*
+* The region outlives its writer: once the writer is gone, another
+* process can take over with openWriter(). Readers need a writer that is
+* mid-write to finish, though: one that dies mid-write leaves the version
+* odd until openWriter() resets it. A reader waiting on an odd version
+* spins, then yields, then sleeps, and lookup() throws once the same odd
+* version has lasted about a second.
+*
+* Key and Value must be trivially copyable, and all processes must agree
+* on their layout; attach() checks the sizes.
+*/
+template <typename Key, typename Value>
+class SharedAVLTree
+{
+public:
+    typedef SharedAVLNode<Key, Value> node_type;
+
+    static const uint32_t LAYOUT_VERSION = 1;
+    // waits on one unchanged odd version before lookup() gives up (about 1 s)
+    static const unsigned MAX_STALLED_WAITS = 1200;
+
+    SharedAVLTree();
+    ~SharedAVLTree();
+    SharedAVLTree(const SharedAVLTree&) = delete;
+    SharedAVLTree& operator=(const SharedAVLTree&) = delete;
+
+    void create(const std::string& path, size_t capacity);
+    void createShared(const std::string& name, size_t capacity);
+    void attach(const std::string& path);
+    void attachShared(const std::string& name);
+    void openWriter(const std::string& path);
+    void openWriterShared(const std::string& name);
+    static void removeShared(const std::string& name);
+    void close();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    bool lookup(const Key& key, Value& value) const;
+    uint64_t version() const;
+    bool empty() const;
+    size_t size() const;
+    size_t capacity() const;
+    size_t regionBytes() const;
+    bool isBalanced() const;
+
+protected:
+    /**
+    * The start of the region. The node array follows, 64-byte aligned.
+    */
+    struct Header
+    {
+        char magic[8];            // "AVLSHM\0"
+        uint32_t layoutVersion;
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t nodeSize;
+        uint64_t capacity;
+        std::atomic<uint64_t> version;
+        uint64_t size;
+        uint64_t used;            // nodes ever handed out by the bump allocator
+        OffsetPtr<node_type> root;
+        OffsetPtr<node_type> freeList; // threaded through left_
+    };
+
+    static size_t nodesOffset();
+    void initRegion(int fd, size_t capacity, const std::string& path);
+    void mapRegion(int fd, const std::string& path, bool writable);
+    void beginWrite();
+    void endWrite();
+    void requireWriter() const;
+    bool inRegion(uintptr_t address) const;
+    static void waitForWriter(unsigned waits);
+
+    node_type* allocateNode(const Key& key, const Value& value, node_type* parent);
+    void freeNode(node_type* node);
+    void linkAndRetrace(node_type* node, node_type* parent);
+    void unlinkAndRetrace(node_type* node);
+    bool rotateP(node_type* p, node_type* c);
+    void rotateLeft(node_type* head);
+    void rotateRight(node_type* head);
+    void replaceChild(node_type* parent, node_type* oldChild, node_type* newChild);
+    int heightHelper(const node_type* node) const;
+
+    void* map_;
+    size_t mapLength_;
+    bool writable_;
+    Header* header_;
+    node_type* nodes_;
+
+    static_assert(std::is_trivially_copyable<Key>::value, "shared keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "shared values must be trivially copyable");
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the version counter must be lock-free to be shared");
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the SharedAVLTree class.
+  --------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+SharedAVLTree<Key, Value>::SharedAVLTree() :
+    map_(nullptr), mapLength_(0), writable_(false), header_(nullptr), nodes_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value>
+SharedAVLTree<Key, Value>::~SharedAVLTree()
+{
+  close();
+}
+
+/**
+* Creates (or truncates) the file at path as an empty tree with room for
+* capacity nodes, and maps it for writing. This process becomes the writer.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::create(const std::string& path, size_t capacity)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot create " + path);
+  }
+  initRegion(fd, capacity, path);
+}
+
+/**
+* As create(), backed by the POSIX shared memory object name (e.g.
+* "/orders"), which lives in RAM and disappears on reboot or removeShared().
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::createShared(const std::string& name, size_t capacity)
+{
+  close();
+  int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot create shared memory " + name);
+  }
+  initRegion(fd, capacity, name);
+}
+
+/**
+* Maps an existing tree file read-only. Throws std::runtime_error if it is
+* missing or was created with another layout.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::attach(const std::string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot open " + path);
+  }
+  mapRegion(fd, path, false);
+}
+
+/**
+* As attach(), for a tree made with createShared().
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::attachShared(const std::string& name)
+{
+  close();
+  int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot open shared memory " + name);
+  }
+  mapRegion(fd, name, false);
+}
+
+/**
+* Maps an existing tree file for writing, making this process the writer
+* again; the caller must make sure the previous writer is gone. Throws
+* std::runtime_error if it is missing or was created with another layout.
+* If the previous writer died mid-write, the version is moved on to even
+* so that readers stop waiting; the write it died in may be half done.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::openWriter(const std::string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDWR);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot open " + path);
+  }
+  mapRegion(fd, path, true);
+}
+
+/**
+* As openWriter(), for a tree made with createShared().
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::openWriterShared(const std::string& name)
+{
+  close();
+  int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot open shared memory " + name);
+  }
+  mapRegion(fd, name, true);
+}
+
+/**
+* Removes a shared memory object. Processes that have it mapped keep it
+* until they close.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::removeShared(const std::string& name)
+{
+  ::shm_unlink(name.c_str());
+}
+
+/**
+* Unmaps the region. The tree itself stays in the file or shared memory.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::close()
+{
+  if (map_ != nullptr)
+  {
+    ::munmap(map_, mapLength_);
+  }
+  map_ = nullptr;
+  mapLength_ = 0;
+  writable_ = false;
+  header_ = nullptr;
+  nodes_ = nullptr;
+}
+
+/**
+* If key is already in the tree, the current value is overwritten.
+* Throws std::runtime_error if the region is full or attached read-only.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  requireWriter();
+  node_type* parent = nullptr;
+  node_type* currNode = header_->root.get();
+  while (currNode != nullptr)
+  {
+    if (currNode->key_ == keyValuePair.first)
+    {
+      beginWrite();
+      currNode->value_ = keyValuePair.second;
+      endWrite();
+      return;
+    }
+    parent = currNode;
+    currNode = (keyValuePair.first < currNode->key_) ? currNode->left_.get() : currNode->right_.get();
+  }
+  if (header_->freeList.get() == nullptr && header_->used == header_->capacity)
+  {
+    throw std::runtime_error("shared tree is full");
+  }
+  beginWrite();
+  linkAndRetrace(allocateNode(keyValuePair.first, keyValuePair.second, parent), parent);
+  endWrite();
+}
+
+/**
+* Removes the key if it exists. A node with 2 children takes over its
+* predecessor's key and value, and the predecessor is unlinked instead;
+* plain copies are fine because both are trivially copyable.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::remove(const Key& key)
+{
+  requireWriter();
+  node_type* currNode = header_->root.get();
+  while (currNode != nullptr && !(currNode->key_ == key))
+  {
+    currNode = (key < currNode->key_) ? currNode->left_.get() : currNode->right_.get();
+  }
+  if (currNode == nullptr)
+  {
+    return;
+  }
+  beginWrite();
+  if (currNode->left_.get() != nullptr && currNode->right_.get() != nullptr)
+  {
+    node_type* pred = currNode->left_.get();
+    while (pred->right_.get() != nullptr)
+    {
+      pred = pred->right_.get();
+    }
+    currNode->key_ = pred->key_;
+    currNode->value_ = pred->value_;
+    currNode = pred;
+  }
+  unlinkAndRetrace(currNode);
+  freeNode(currNode);
+  endWrite();
+}
+
+/**
+* Removes every entry. The region keeps its size.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::clear()
+{
+  requireWriter();
+  beginWrite();
+  header_->root.set(nullptr);
+  header_->freeList.set(nullptr);
+  header_->size = 0;
+  header_->used = 0;
+  endWrite();
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false
+* if the key is absent. Safe to call while the writer process modifies
+* the tree; the read is retried until it saw no write. Throws if a write
+* never finishes, i.e. the writer died in the middle of one.
+*/
+template<typename Key, typename Value>
+bool SharedAVLTree<Key, Value>::lookup(const Key& key, Value& value) const
+{
+  if (header_ == nullptr)
+  {
+    return false;
+  }
+  uint64_t stalledVersion = 0;
+  unsigned waits = 0;
+  while (true)
+  {
+    uint64_t before = header_->version.load(std::memory_order_acquire);
+    if (before & 1)
+    {
+      //a version that keeps moving means a live writer, so only the time
+      //spent on one and the same write counts
+      if (before != stalledVersion)
+      {
+        stalledVersion = before;
+        waits = 0;
+      }
+      if (++waits > MAX_STALLED_WAITS)
+      {
+        throw std::runtime_error("shared tree writer stopped in the middle of a write");
+      }
+      waitForWriter(waits);
+      continue;
+    }
+    bool found = false;
+    bool torn = false;
+    // an AVL tree of any size that fits in memory is far shallower than this
+    int steps = 0;
+    uintptr_t address = header_->root.address();
+    while (address != 0)
+    {
+      if (!inRegion(address) || ++steps > 128)
+      {
+        torn = true;
+        break;
+      }
+      const node_type* currNode = reinterpret_cast<const node_type*>(address);
+      if (currNode->key_ == key)
+      {
+        value = currNode->value_;
+        found = true;
+        break;
+      }
+      address = (key < currNode->key_) ? currNode->left_.address() : currNode->right_.address();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!torn && header_->version.load(std::memory_order_relaxed) == before)
+    {
+      return found;
+    }
+  }
+}
+
+/**
+* Backs off before the given wait on an unfinished write: spins at first,
+* since writes are short, then yields, then sleeps for up to 1 ms.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::waitForWriter(unsigned waits)
+{
+  if (waits <= 64)
+  {
+    return;
+  }
+  if (waits <= 128)
+  {
+    sched_yield();
+    return;
+  }
+  usleep(std::min(1u << std::min(waits - 129, 10u), 1000u));
+}
+
+/**
+* The write counter: even when the tree is quiescent, and advanced by 2
+* by every insert, remove or clear. A reader that sees it unchanged
+* across several lookups knows they all saw the same tree.
+*/
+template<typename Key, typename Value>
+uint64_t SharedAVLTree<Key, Value>::version() const
+{
+  return (header_ == nullptr) ? 0 : header_->version.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value>
+bool SharedAVLTree<Key, Value>::empty() const
+{
+  return size() == 0;
+}
+
+template<typename Key, typename Value>
+size_t SharedAVLTree<Key, Value>::size() const
+{
+  return (header_ == nullptr) ? 0 : header_->size;
+}
+
+template<typename Key, typename Value>
+size_t SharedAVLTree<Key, Value>::capacity() const
+{
+  return (header_ == nullptr) ? 0 : header_->capacity;
+}
+
+/**
+* The size of the mapping, which every attached process shares.
+*/
+template<typename Key, typename Value>
+size_t SharedAVLTree<Key, Value>::regionBytes() const
+{
+  return mapLength_;
+}
+
+/**
+* Return true iff the tree is balanced. Only meaningful in the writer or
+* while no write is in progress.
+*/
+template<typename Key, typename Value>
+bool SharedAVLTree<Key, Value>::isBalanced() const
+{
+  return header_ == nullptr || heightHelper(header_->root.get()) != -1;
+}
+
+template<typename Key, typename Value>
+size_t SharedAVLTree<Key, Value>::nodesOffset()
+{
+  return (sizeof(Header) + 63) & ~static_cast<size_t>(63);
+}
+
+/**
+* Sizes the freshly opened region for capacity nodes, maps it and writes
+* an empty header. Takes ownership of fd.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::initRegion(int fd, size_t capacity, const std::string& path)
+{
+  size_t length = nodesOffset() + capacity * sizeof(node_type);
+  if (::ftruncate(fd, length) != 0)
+  {
+    ::close(fd);
+    throw std::runtime_error("cannot size " + path);
+  }
+  void* map = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+  {
+    throw std::runtime_error("cannot map " + path);
+  }
+  map_ = map;
+  mapLength_ = length;
+  writable_ = true;
+  header_ = new (map_) Header();
+  std::memcpy(header_->magic, "AVLSHM", 7);
+  header_->layoutVersion = LAYOUT_VERSION;
+  header_->keySize = sizeof(Key);
+  header_->valueSize = sizeof(Value);
+  header_->nodeSize = sizeof(node_type);
+  header_->capacity = capacity;
+  header_->version.store(0, std::memory_order_release);
+  nodes_ = reinterpret_cast<node_type*>(static_cast<char*>(map_) + nodesOffset());
+}
+
+/**
+* Maps an existing region, read-only unless writable, and checks its
+* header. A writer resets a version left odd by a writer that died.
+* Takes ownership of fd.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::mapRegion(int fd, const std::string& path, bool writable)
+{
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < nodesOffset())
+  {
+    ::close(fd);
+    throw std::runtime_error(path + " is not a shared tree");
+  }
+  void* map = ::mmap(nullptr, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+  {
+    throw std::runtime_error("cannot map " + path);
+  }
+  map_ = map;
+  mapLength_ = st.st_size;
+  header_ = static_cast<Header*>(map_);
+  if (std::memcmp(header_->magic, "AVLSHM", 7) != 0 || header_->layoutVersion != LAYOUT_VERSION
+      || header_->keySize != sizeof(Key) || header_->valueSize != sizeof(Value)
+      || header_->nodeSize != sizeof(node_type)
+      || nodesOffset() + header_->capacity * sizeof(node_type) > mapLength_)
+  {
+    close();
+    throw std::runtime_error(path + " is not a compatible shared tree");
+  }
+  nodes_ = reinterpret_cast<node_type*>(static_cast<char*>(map_) + nodesOffset());
+  writable_ = writable;
+  if (writable_ && (header_->version.load(std::memory_order_acquire) & 1) != 0)
+  {
+    header_->version.fetch_add(1, std::memory_order_release);
+  }
+}
+
+/**
+* Makes the version odd before the writer touches the tree.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::beginWrite()
+{
+  header_->version.store(header_->version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+/**
+* Makes the version even again, publishing the write.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::endWrite()
+{
+  header_->version.store(header_->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::requireWriter() const
+{
+  if (!writable_)
+  {
+    throw std::runtime_error("shared tree is not open for writing");
+  }
+}
+
+/**
+* Returns true if address is the start of a node slot in this mapping.
+*/
+template<typename Key, typename Value>
+bool SharedAVLTree<Key, Value>::inRegion(uintptr_t address) const
+{
+  uintptr_t first = reinterpret_cast<uintptr_t>(nodes_);
+  return address >= first && address < first + header_->capacity * sizeof(node_type)
+      && (address - first) % sizeof(node_type) == 0;
+}
+
+/**
+* Takes a node from the free list, or the next never-used slot.
+*/
+template<typename Key, typename Value>
+typename SharedAVLTree<Key, Value>::node_type*
+SharedAVLTree<Key, Value>::allocateNode(const Key& key, const Value& value, node_type* parent)
+{
+  node_type* node = header_->freeList.get();
+  if (node != nullptr)
+  {
+    header_->freeList.set(node->left_.get());
+  }
+  else
+  {
+    node = nodes_ + header_->used++;
+  }
+  node->parent_.set(parent);
+  node->left_.set(nullptr);
+  node->right_.set(nullptr);
+  node->balance_ = 0;
+  node->key_ = key;
+  node->value_ = value;
+  return node;
+}
+
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::freeNode(node_type* node)
+{
+  node->parent_.set(nullptr);
+  node->right_.set(nullptr);
+  node->left_.set(header_->freeList.get());
+  header_->freeList.set(node);
+}
+
+/**
+* Links a new leaf under parent (as the root if parent is nullptr) and
+* retraces, as AVLTree::linkNode does.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::linkAndRetrace(node_type* node, node_type* parent)
+{
+  header_->size++;
+  if (parent == nullptr)
+  {
+    header_->root.set(node);
+    return;
+  }
+  if (node->key_ < parent->key_)
+  {
+    parent->left_.set(node);
+  }
+  else
+  {
+    parent->right_.set(node);
+  }
+  while (parent != nullptr)
+  {
+    parent->balance_ += (node == parent->left_.get()) ? -1 : 1;
+    if (parent->balance_ == 0 || rotateP(parent, node))
+    {
+      break;
+    }
+    node = parent;
+    parent = parent->parent_.get();
+  }
+}
+
+/**
+* Unlinks a node with at most one child and retraces, as AVLTree::detach
+* does.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::unlinkAndRetrace(node_type* node)
+{
+  header_->size--;
+  node_type* child = (node->left_.get() != nullptr) ? node->left_.get() : node->right_.get();
+  node_type* parent = node->parent_.get();
+  int8_t diff = 0;
+  if (parent != nullptr)
+  {
+    diff = (parent->left_.get() == node) ? 1 : -1;
+  }
+  if (child != nullptr)
+  {
+    child->parent_.set(parent);
+  }
+  replaceChild(parent, node, child);
+
+  //retrace: parent's subtree on the side of diff lost one level of height
+  while (parent != nullptr)
+  {
+    node_type* grandParent = parent->parent_.get();
+    int8_t nextDiff = 0;
+    if (grandParent != nullptr)
+    {
+      nextDiff = (grandParent->left_.get() == parent) ? 1 : -1;
+    }
+    parent->balance_ += diff;
+    if (parent->balance_ == 1 || parent->balance_ == -1)
+    {
+      //height of parent's subtree is unchanged
+      break;
+    }
+    if (parent->balance_ != 0)
+    {
+      node_type* heavy = (parent->balance_ > 0) ? parent->right_.get() : parent->left_.get();
+      int8_t heavyBalance = heavy->balance_;
+      rotateP(parent, heavy);
+      if (heavyBalance == 0)
+      {
+        //single rotation around an even child keeps the height
+        break;
+      }
+    }
+    parent = grandParent;
+    diff = nextDiff;
+  }
+}
+
+/**
+* Rotates around p if it is out of balance, with c its child on the heavy
+* side, fixing up balances. Returns true if it rotated.
+*/
+template<typename Key, typename Value>
+bool SharedAVLTree<Key, Value>::rotateP(node_type* p, node_type* c)
+{
+  if (p->balance_ > 1)
+  {
+    if (c->balance_ < 0)
+    {
+      node_type* grandC = c->left_.get(); // must exist bc of balance factor
+      p->balance_ = (grandC->balance_ == 1) ? -1 : 0;
+      c->balance_ = (grandC->balance_ == -1) ? 1 : 0;
+      grandC->balance_ = 0;
+      rotateRight(c);
+      rotateLeft(p);
+    }
+    else
+    {
+      //c can only be even after a removal, then the height is kept
+      p->balance_ = (c->balance_ == 0) ? 1 : 0;
+      c->balance_ = (c->balance_ == 0) ? -1 : 0;
+      rotateLeft(p);
+    }
+  }
+  else if (p->balance_ < -1)
+  {
+    if (c->balance_ > 0)
+    {
+      node_type* grandC = c->right_.get(); // must exist bc of balance factor
+      p->balance_ = (grandC->balance_ == -1) ? 1 : 0;
+      c->balance_ = (grandC->balance_ == 1) ? -1 : 0;
+      grandC->balance_ = 0;
+      rotateLeft(c);
+      rotateRight(p);
+    }
+    else
+    {
+      p->balance_ = (c->balance_ == 0) ? -1 : 0;
+      c->balance_ = (c->balance_ == 0) ? 1 : 0;
+      rotateRight(p);
+    }
+  }
+  else
+    return false;
+  return true;
+}
+
+/**
+* Rotates head's right child up into head's place; head becomes its left child.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::rotateLeft(node_type* head)
+{
+  node_type* top = head->right_.get();
+  node_type* moved = top->left_.get();
+  head->right_.set(moved);
+  if (moved != nullptr)
+    moved->parent_.set(head);
+  top->parent_.set(head->parent_.get());
+  replaceChild(head->parent_.get(), head, top);
+  top->left_.set(head);
+  head->parent_.set(top);
+}
+
+/**
+* Rotates head's left child up into head's place; head becomes its right child.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::rotateRight(node_type* head)
+{
+  node_type* top = head->left_.get();
+  node_type* moved = top->right_.get();
+  head->left_.set(moved);
+  if (moved != nullptr)
+    moved->parent_.set(head);
+  top->parent_.set(head->parent_.get());
+  replaceChild(head->parent_.get(), head, top);
+  top->right_.set(head);
+  head->parent_.set(top);
+}
+
+/**
+* Points parent's link to oldChild (or the root, if parent is nullptr) at
+* newChild.
+*/
+template<typename Key, typename Value>
+void SharedAVLTree<Key, Value>::replaceChild(node_type* parent, node_type* oldChild, node_type* newChild)
+{
+  if (parent == nullptr)
+    header_->root.set(newChild);
+  else if (parent->left_.get() == oldChild)
+    parent->left_.set(newChild);
+  else
+    parent->right_.set(newChild);
+}
+
+/**
+* Returns the height of the subtree, or -1 if it is unbalanced or a
+* stored balance is wrong.
+*/
+template<typename Key, typename Value>
+int SharedAVLTree<Key, Value>::heightHelper(const node_type* node) const
+{
+  if (node == nullptr)
+  {
+    return 0;
+  }
+  int leftHeight = heightHelper(node->left_.get());
+  int rightHeight = heightHelper(node->right_.get());
+  if (leftHeight == -1 || rightHeight == -1 || rightHeight - leftHeight != node->balance_
+      || std::abs(rightHeight - leftHeight) > 1)
+  {
+    return -1;
+  }
+  return 1 + std::max(leftHeight, rightHeight);
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the SharedAVLTree class.
+  ------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef SLABAVL_H
+#define SLABAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* A slab of values addressed by small integer handles. Released handles are
+* recycled, and a std::deque keeps references stable while the slab grows.
+*/
+template <typename Value>
+class ValueSlab
+{
+public:
+    size_t allocate(const Value& value);
+    void release(size_t handle);
+    Value& get(size_t handle);
+    const Value& get(size_t handle) const;
+    void clear();
+
+protected:
+    std::deque<Value> values_;
+    std::vector<size_t> free_;
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the ValueSlab class.
+  ----------------------------------------------
+*/
+
+/**
+* Stores a copy of value, reusing a released slot when one exists, and
+* returns its handle.
+*/
+template<typename Value>
+size_t ValueSlab<Value>::allocate(const Value& value)
+{
+  if (!free_.empty())
+  {
+    size_t handle = free_.back();
+    free_.pop_back();
+    values_[handle] = value;
+    return handle;
+  }
+  values_.push_back(value);
+  return values_.size() - 1;
+}
+
+/**
+* Returns a slot to the free list. The slot is reset so that any resources
+* owned by the old value are dropped now rather than on reuse.
+*/
+template<typename Value>
+void ValueSlab<Value>::release(size_t handle)
+{
+  values_[handle] = Value();
+  free_.push_back(handle);
+}
+
+/**
+* A non-const getter for the value behind a handle.
+*/
+template<typename Value>
+Value& ValueSlab<Value>::get(size_t handle)
+{
+  return values_[handle];
+}
+
+/**
+* A const getter for the value behind a handle.
+*/
+template<typename Value>
+const Value& ValueSlab<Value>::get(size_t handle) const
+{
+  return values_[handle];
+}
+
+/**
+* Drops every value and handle.
+*/
+template<typename Value>
+void ValueSlab<Value>::clear()
+{
+  values_.clear();
+  free_.clear();
+}
+
+/*
+  --------------------------------------------
+  End implementations for the ValueSlab class.
+  --------------------------------------------
+*/
+
+/**
+* An AVL tree whose nodes hold only the key and a handle into a ValueSlab.
+* Searches only touch the small key nodes; the value is dereferenced when
+* the caller actually reads it through the iterator or operator[].
+*/
+template <typename Key, typename Value>
+class SlabAVLTree
+{
+public:
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+
+    /**
+    * An iterator yielding (key, value) reference pairs; the value lives in
+    * the slab and is only loaded when used.
+    */
+    class iterator
+    {
+    public:
+        typedef std::pair<const Key&, Value&> reference;
+
+        // Holds a reference pair so that it->first / it->second work
+        struct pointer
+        {
+            reference item_;
+            reference* operator->() { return &item_; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class SlabAVLTree<Key, Value>;
+        iterator(typename AVLTree<Key, size_t>::iterator it, ValueSlab<Value>* slab);
+        typename AVLTree<Key, size_t>::iterator it_;
+        ValueSlab<Value>* slab_;
+    };
+
+    iterator begin();
+    iterator end();
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    /**
+    * The key-to-handle tree, opening up AVLTree's single-descent insert
+    * and remove steps to the slab tree.
+    */
+    class Index : public AVLTree<Key, size_t>
+    {
+    public:
+        using AVLTree<Key, size_t>::findSlot;
+        using AVLTree<Key, size_t>::linkNode;
+        using AVLTree<Key, size_t>::removeNode;
+    };
+
+    Index index_;
+    ValueSlab<Value> slab_;
+};
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the SlabAVLTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+/**
+* Explicit constructor wrapping an index iterator.
+*/
+template<typename Key, typename Value>
+SlabAVLTree<Key, Value>::iterator::iterator(
+    typename AVLTree<Key, size_t>::iterator it, ValueSlab<Value>* slab) :
+    it_(it), slab_(slab)
+{
+
+}
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<typename Key, typename Value>
+SlabAVLTree<Key, Value>::iterator::iterator() :
+    slab_(nullptr)
+{
+
+}
+
+/**
+* Returns the key and a reference to the value in the slab.
+*/
+template<typename Key, typename Value>
+typename SlabAVLTree<Key, Value>::iterator::reference
+SlabAVLTree<Key, Value>::iterator::operator*() const
+{
+  return reference(it_->first, slab_->get(it_->second));
+}
+
+/**
+* Provides member access to the (key, value) reference pair.
+*/
+template<typename Key, typename Value>
+typename SlabAVLTree<Key, Value>::iterator::pointer
+SlabAVLTree<Key, Value>::iterator::operator->() const
+{
+  pointer p = { **this };
+  return p;
+}
+
+template<typename Key, typename Value>
+bool SlabAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+  return it_ == rhs.it_;
+}
+
+template<typename Key, typename Value>
+bool SlabAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+  return !(*this == rhs);
+}
+
+/**
+* Advances in key order.
+*/
+template<typename Key, typename Value>
+typename SlabAVLTree<Key, Value>::iterator&
+SlabAVLTree<Key, Value>::iterator::operator++()
+{
+  ++it_;
+  return *this;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the SlabAVLTree::iterator class.
+  -------------------------------------------------------
+*/
+
+/*
+  ------------------------------------------------
+  Begin implementations for the SlabAVLTree class.
+  ------------------------------------------------
+*/
+
+/**
+* Inserts a key/value pair, overwriting the slab value if the key exists.
+* One descent finds either the key or the slot to link it under.
+*/
+template<typename Key, typename Value>
+void SlabAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  AVLNode<Key, size_t>* parent;
+  size_t depth;
+  AVLNode<Key, size_t>* node = index_.findSlot(keyValuePair.first, parent, depth);
+  if (node != nullptr)
+  {
+    slab_.get(node->getValue()) = keyValuePair.second;
+    return;
+  }
+  node = new AVLNode<Key, size_t>(keyValuePair.first, slab_.allocate(keyValuePair.second), parent);
+  index_.linkNode(node, parent, depth);
+}
+
+/**
+* Removes the key and releases its slab slot.
+*/
+template<typename Key, typename Value>
+void SlabAVLTree<Key, Value>::remove(const Key& key)
+{
+  AVLNode<Key, size_t>* parent;
+  size_t depth;
+  AVLNode<Key, size_t>* node = index_.findSlot(key, parent, depth);
+  if (node == nullptr)
+  {
+    return;
+  }
+  slab_.release(node->getValue());
+  index_.removeNode(node);
+}
+
+template<typename Key, typename Value>
+void SlabAVLTree<Key, Value>::clear()
+{
+  index_.clear();
+  slab_.clear();
+}
+
+template<typename Key, typename Value>
+bool SlabAVLTree<Key, Value>::empty() const
+{
+  return index_.empty();
+}
+
+template<typename Key, typename Value>
+typename SlabAVLTree<Key, Value>::iterator SlabAVLTree<Key, Value>::begin()
+{
+  return iterator(index_.begin(), &slab_);
+}
+
+template<typename Key, typename Value>
+typename SlabAVLTree<Key, Value>::iterator SlabAVLTree<Key, Value>::end()
+{
+  return iterator(index_.end(), &slab_);
+}
+
+/**
+* Returns an iterator to the key, or end(). Only key nodes are visited.
+*/
+template<typename Key, typename Value>
+typename SlabAVLTree<Key, Value>::iterator SlabAVLTree<Key, Value>::find(const Key& key)
+{
+  return iterator(index_.find(key), &slab_);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value& SlabAVLTree<Key, Value>::operator[](const Key& key)
+{
+  return slab_.get(index_[key]);
+}
+template<typename Key, typename Value>
+Value const & SlabAVLTree<Key, Value>::operator[](const Key& key) const
+{
+  return slab_.get(index_[key]);
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the SlabAVLTree class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef SMALLAVL_H
+#define SMALLAVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <utility>
+#include "avlbst.h"
+#include "sortedrun.h"
+
+/**
+* A map that keeps up to N entries inline in a SortedRun and promotes to an
+* AVLTree once an (N+1)th key is inserted. Tiny maps therefore cost no heap
+* allocation at all. Once promoted the map stays an AVLTree until it is
+* emptied, so a map hovering around N entries does not flip back and forth.
+* Maps copy and move like their run and tree, so they can be kept by value
+* in containers; a moved-from map is empty.
+*/
+template <typename Key, typename Value, size_t N = 8>
+class SmallAVLTree
+{
+public:
+    typedef std::pair<const Key, Value> item_type;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    bool isInline() const;
+
+    /**
+    * An in-order iterator over either representation.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        item_type& operator*() const;
+        item_type* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class SmallAVLTree<Key, Value, N>;
+        iterator(SortedRun<Key, Value, N>* run, size_t index);
+        iterator(typename AVLTree<Key, Value>::iterator it);
+
+        // run_ is NULL when iterating the promoted tree
+        SortedRun<Key, Value, N>* run_;
+        size_t index_;
+        typename AVLTree<Key, Value>::iterator it_;
+    };
+
+    iterator begin();
+    iterator end();
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+protected:
+    void promote();
+
+    SortedRun<Key, Value, N> small_;
+    AVLTree<Key, Value> tree_;
+};
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the SmallAVLTree::iterator class.
+  ---------------------------------------------------------
+*/
+
+/**
+* Constructor for a position in the inline run.
+*/
+template<typename Key, typename Value, size_t N>
+SmallAVLTree<Key, Value, N>::iterator::iterator(SortedRun<Key, Value, N>* run, size_t index) :
+    run_(run), index_(index)
+{
+
+}
+
+/**
+* Constructor for a position in the promoted tree.
+*/
+template<typename Key, typename Value, size_t N>
+SmallAVLTree<Key, Value, N>::iterator::iterator(typename AVLTree<Key, Value>::iterator it) :
+    run_(NULL), index_(0), it_(it)
+{
+
+}
+
+/**
+* A default constructor that initializes the iterator to NULL.
+*/
+template<typename Key, typename Value, size_t N>
+SmallAVLTree<Key, Value, N>::iterator::iterator() :
+    run_(NULL), index_(0)
+{
+
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::item_type&
+SmallAVLTree<Key, Value, N>::iterator::operator*() const
+{
+  if (run_ != NULL)
+  {
+    return run_->at(index_);
+  }
+  return *it_;
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::item_type*
+SmallAVLTree<Key, Value, N>::iterator::operator->() const
+{
+  return &(**this);
+}
+
+template<typename Key, typename Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::iterator::operator==(const iterator& rhs) const
+{
+  return run_ == rhs.run_ && index_ == rhs.index_ && it_ == rhs.it_;
+}
+
+template<typename Key, typename Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::iterator::operator!=(const iterator& rhs) const
+{
+  return !(*this == rhs);
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator&
+SmallAVLTree<Key, Value, N>::iterator::operator++()
+{
+  if (run_ != NULL)
+  {
+    index_++;
+  }
+  else
+  {
+    ++it_;
+  }
+  return *this;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the SmallAVLTree::iterator class.
+  -------------------------------------------------------
+*/
+
+/*
+  -------------------------------------------------
+  Begin implementations for the SmallAVLTree class.
+  -------------------------------------------------
+*/
+
+/**
+* Inserts into the inline run while it has room, promoting to the AVL tree
+* on overflow. If key is already present its value is overwritten.
+*/
+template<typename Key, typename Value, size_t N>
+void SmallAVLTree<Key, Value, N>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  if (!isInline())
+  {
+    tree_.insert(keyValuePair);
+    return;
+  }
+  size_t index = small_.lowerBound(keyValuePair.first);
+  if (index < small_.size() && small_.at(index).first == keyValuePair.first)
+  {
+    small_.at(index).second = keyValuePair.second;
+    return;
+  }
+  if (!small_.full())
+  {
+    small_.insertAt(index, keyValuePair);
+    return;
+  }
+  promote();
+  tree_.insert(keyValuePair);
+}
+
+template<typename Key, typename Value, size_t N>
+void SmallAVLTree<Key, Value, N>::remove(const Key& key)
+{
+  if (!isInline())
+  {
+    tree_.remove(key);
+    return;
+  }
+  size_t index = small_.indexOf(key);
+  if (index != small_.size())
+  {
+    small_.eraseAt(index);
+  }
+}
+
+template<typename Key, typename Value, size_t N>
+void SmallAVLTree<Key, Value, N>::clear()
+{
+  small_.clear();
+  tree_.clear();
+}
+
+template<typename Key, typename Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::empty() const
+{
+  return small_.empty() && tree_.empty();
+}
+
+/**
+* Returns true while the entries are stored inline rather than in the tree.
+*/
+template<typename Key, typename Value, size_t N>
+bool SmallAVLTree<Key, Value, N>::isInline() const
+{
+  return tree_.empty();
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator SmallAVLTree<Key, Value, N>::begin()
+{
+  if (isInline())
+  {
+    return iterator(&small_, 0);
+  }
+  return iterator(tree_.begin());
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator SmallAVLTree<Key, Value, N>::end()
+{
+  if (isInline())
+  {
+    return iterator(&small_, small_.size());
+  }
+  return iterator(tree_.end());
+}
+
+template<typename Key, typename Value, size_t N>
+typename SmallAVLTree<Key, Value, N>::iterator SmallAVLTree<Key, Value, N>::find(const Key& key)
+{
+  if (isInline())
+  {
+    return iterator(&small_, small_.indexOf(key));
+  }
+  return iterator(tree_.find(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, size_t N>
+Value& SmallAVLTree<Key, Value, N>::operator[](const Key& key)
+{
+  if (isInline())
+  {
+    size_t index = small_.indexOf(key);
+    if (index == small_.size()) throw std::out_of_range("Invalid key");
+    return small_.at(index).second;
+  }
+  return tree_[key];
+}
+
+/**
+* Moves every inline entry into the AVL tree.
+*/
+template<typename Key, typename Value, size_t N>
+void SmallAVLTree<Key, Value, N>::promote()
+{
+  for (size_t i = 0; i < small_.size(); i++)
+  {
+    tree_.insert(small_.at(i));
+  }
+  small_.clear();
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the SmallAVLTree class.
+  -----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,572 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bst.h"
+
+/**
+* One entry of a snapshot. A plain struct rather than std::pair so that it
+* is trivially copyable and can be read straight out of the mapped file;
+* it still has first/second so it reads like a tree item.
+*/
+template <typename Key, typename Value>
+struct SnapshotEntry
+{
+    Key first;
+    Value second;
+};
+
+/**
+* The fixed-size header at offset 0 of a snapshot file. All offsets are
+* from the start of the file and all sections are 64-byte aligned.
+*/
+struct SnapshotHeader
+{
+    char magic[8];            // "AVLSNAP\0"
+    uint32_t version;
+    uint32_t byteOrder;       // BYTE_ORDER_MARK as written by the saving host
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t entrySize;
+    uint32_t fenceStride;     // 0 when there is no fence index
+    uint64_t count;
+    uint64_t entriesOffset;
+    uint64_t fencesOffset;
+    uint64_t fenceCount;
+    uint64_t checksum;        // FNV-1a over everything after the header
+};
+
+template <typename Key, typename Value>
+class SnapshotWriter;
+
+/**
+* A read-only ordered map served directly from a memory-mapped snapshot
+* file. save() writes the entries of any BinarySearchTree in key order,
+* optionally followed by a fence index (the key of every fenceStride-th
+* entry) so that a lookup binary searches a small, cache-resident array
+* before touching the entry pages. load() maps the file and checks the
+* header only; nothing is parsed or copied, and pages are faulted in as
+* they are used. verify() checks the checksum on demand, which does read
+* the whole file.
+*
+* Key and Value must be trivially copyable, and a snapshot can only be
+* loaded on a host with the same byte order and type sizes.
+*/
+template <typename Key, typename Value>
+class MappedSnapshot
+{
+public:
+    typedef SnapshotEntry<Key, Value> item_type;
+    typedef const item_type* iterator;
+
+    static const uint32_t VERSION = 1;
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static const uint32_t DEFAULT_FENCE_STRIDE = 64;
+
+    MappedSnapshot();
+    ~MappedSnapshot();
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    static void save(const BinarySearchTree<Key, Value>& tree, const std::string& path,
+        uint32_t fenceStride = DEFAULT_FENCE_STRIDE);
+    void load(const std::string& path);
+    void close();
+    bool verify() const;
+
+    bool empty() const;
+    size_t size() const;
+    bool hasIndex() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator lowerBound(const Key& key) const;
+    iterator find(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    friend class SnapshotWriter<Key, Value>;
+
+    static uint64_t checksum(const unsigned char* data, size_t length, uint64_t hash);
+    static size_t alignUp(size_t offset);
+    static void writeAll(int fd, const void* data, size_t length, uint64_t& hash);
+
+    void* map_;
+    size_t mapLength_;
+    const item_type* entries_;
+    const Key* fences_;
+    size_t count_;
+    size_t fenceCount_;
+    uint32_t fenceStride_;
+
+    static_assert(std::is_trivially_copyable<Key>::value, "snapshot keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "snapshot values must be trivially copyable");
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the MappedSnapshot class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+MappedSnapshot<Key, Value>::MappedSnapshot() :
+    map_(nullptr), mapLength_(0), entries_(nullptr), fences_(nullptr),
+    count_(0), fenceCount_(0), fenceStride_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+MappedSnapshot<Key, Value>::~MappedSnapshot()
+{
+  close();
+}
+
+/**
+* Writes the tree's entries to path in key order, with a fence index
+* unless fenceStride is 0. See SnapshotWriter for how the file is written.
+*/
+template<typename Key, typename Value>
+void MappedSnapshot<Key, Value>::save(const BinarySearchTree<Key, Value>& tree, const std::string& path,
+    uint32_t fenceStride)
+{
+  SnapshotWriter<Key, Value> writer(path, fenceStride);
+  for (typename BinarySearchTree<Key, Value>::iterator it = tree.begin(); it != tree.end(); ++it)
+  {
+    writer.append(it->first, it->second);
+  }
+  writer.commit();
+}
+
+/**
+* Maps the snapshot at path, replacing any snapshot already loaded.
+* Throws std::runtime_error if the file is missing, truncated, or was
+* written by another version, byte order or Key/Value layout.
+*/
+template<typename Key, typename Value>
+void MappedSnapshot<Key, Value>::load(const std::string& path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    throw std::runtime_error("cannot open " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader))
+  {
+    ::close(fd);
+    throw std::runtime_error(path + " is not a snapshot");
+  }
+  void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+  {
+    throw std::runtime_error("cannot map " + path);
+  }
+  map_ = map;
+  mapLength_ = st.st_size;
+
+  const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map_);
+  const char* base = static_cast<const char*>(map_);
+  if (std::memcmp(header->magic, "AVLSNAP", 8) != 0 || header->version != VERSION
+      || header->byteOrder != BYTE_ORDER_MARK || header->keySize != sizeof(Key)
+      || header->valueSize != sizeof(Value) || header->entrySize != sizeof(item_type)
+      || header->entriesOffset + header->count * sizeof(item_type) > mapLength_
+      || header->fencesOffset + header->fenceCount * sizeof(Key) > mapLength_)
+  {
+    close();
+    throw std::runtime_error(path + " is not a compatible snapshot");
+  }
+  entries_ = reinterpret_cast<const item_type*>(base + header->entriesOffset);
+  fences_ = reinterpret_cast<const Key*>(base + header->fencesOffset);
+  count_ = header->count;
+  fenceCount_ = header->fenceCount;
+  fenceStride_ = header->fenceStride;
+}
+
+/**
+* Unmaps the snapshot, invalidating all iterators into it.
+*/
+template<typename Key, typename Value>
+void MappedSnapshot<Key, Value>::close()
+{
+  if (map_ != nullptr)
+  {
+    ::munmap(map_, mapLength_);
+  }
+  map_ = nullptr;
+  mapLength_ = 0;
+  entries_ = nullptr;
+  fences_ = nullptr;
+  count_ = 0;
+  fenceCount_ = 0;
+  fenceStride_ = 0;
+}
+
+/**
+* Recomputes the checksum over the whole file. Returns false if nothing
+* is loaded or the contents have been damaged.
+*/
+template<typename Key, typename Value>
+bool MappedSnapshot<Key, Value>::verify() const
+{
+  if (map_ == nullptr)
+  {
+    return false;
+  }
+  const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map_);
+  const unsigned char* base = static_cast<const unsigned char*>(map_);
+  size_t end = std::max(header->entriesOffset + header->count * sizeof(item_type),
+      header->fencesOffset + header->fenceCount * sizeof(Key));
+  uint64_t hash = checksum(base + header->entriesOffset, end - header->entriesOffset, 14695981039346656037ULL);
+  return hash == header->checksum;
+}
+
+template<typename Key, typename Value>
+bool MappedSnapshot<Key, Value>::empty() const
+{
+  return count_ == 0;
+}
+
+template<typename Key, typename Value>
+size_t MappedSnapshot<Key, Value>::size() const
+{
+  return count_;
+}
+
+/**
+* Returns true if the snapshot carries a fence index.
+*/
+template<typename Key, typename Value>
+bool MappedSnapshot<Key, Value>::hasIndex() const
+{
+  return fenceCount_ != 0;
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator MappedSnapshot<Key, Value>::begin() const
+{
+  return entries_;
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator MappedSnapshot<Key, Value>::end() const
+{
+  return entries_ + count_;
+}
+
+/**
+* Returns an iterator to the first entry whose key is not below key. With
+* a fence index only one stride of entries is searched.
+*/
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator MappedSnapshot<Key, Value>::lowerBound(const Key& key) const
+{
+  size_t lo = 0;
+  size_t hi = count_;
+  if (fenceCount_ != 0)
+  {
+    //the answer lies after the last fence below key, up to the next fence
+    size_t f = std::lower_bound(fences_, fences_ + fenceCount_, key) - fences_;
+    lo = (f == 0) ? 0 : (f - 1) * fenceStride_;
+    hi = std::min(count_, f * static_cast<size_t>(fenceStride_));
+  }
+  size_t len = hi - lo;
+  const item_type* first = entries_ + lo;
+  while (len > 0)
+  {
+    size_t half = len / 2;
+    if (first[half].first < key)
+    {
+      first += half + 1;
+      len -= half + 1;
+    }
+    else
+    {
+      len = half;
+    }
+  }
+  return first;
+}
+
+/**
+* Returns an iterator to the entry with the given key, k
+* or the end iterator if k does not exist in the snapshot
+*/
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator MappedSnapshot<Key, Value>::find(const Key& key) const
+{
+  iterator it = lowerBound(key);
+  if (it != end() && !(key < it->first))
+  {
+    return it;
+  }
+  return end();
+}
+
+/**
+ * @precondition The key exists in the snapshot
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value const & MappedSnapshot<Key, Value>::operator[](const Key& key) const
+{
+  iterator it = find(key);
+  if(it == end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+
+/**
+* Continues an FNV-1a hash over length bytes.
+*/
+template<typename Key, typename Value>
+uint64_t MappedSnapshot<Key, Value>::checksum(const unsigned char* data, size_t length, uint64_t hash)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+template<typename Key, typename Value>
+size_t MappedSnapshot<Key, Value>::alignUp(size_t offset)
+{
+  return (offset + 63) & ~static_cast<size_t>(63);
+}
+
+/**
+* Writes all of data, folding it into hash, retrying writes interrupted
+* by a signal. Throws std::runtime_error on a write error.
+*/
+template<typename Key, typename Value>
+void MappedSnapshot<Key, Value>::writeAll(int fd, const void* data, size_t length, uint64_t& hash)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  hash = checksum(bytes, length, hash);
+  while (length > 0)
+  {
+    ssize_t written = ::write(fd, bytes, length);
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (written < 0)
+    {
+      throw std::runtime_error("snapshot write failed");
+    }
+    bytes += written;
+    length -= written;
+  }
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the MappedSnapshot class.
+  -------------------------------------------------
+*/
+
+/**
+* Streams entries, which must arrive in increasing key order, into a new
+* snapshot file; MappedSnapshot::save is a loop over a tree around one.
+* The file is written under a temporary name and only synced and renamed
+* into place by commit(), so a crash never leaves a torn snapshot at path.
+* A writer destroyed without commit() removes its temporary file.
+* Throws std::runtime_error if the file cannot be written.
+*/
+template <typename Key, typename Value>
+class SnapshotWriter
+{
+public:
+    typedef SnapshotEntry<Key, Value> item_type;
+
+    SnapshotWriter(const std::string& path,
+        uint32_t fenceStride = MappedSnapshot<Key, Value>::DEFAULT_FENCE_STRIDE);
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    void append(const Key& key, const Value& value);
+    size_t size() const;
+    void commit();
+
+protected:
+    void flushBatch();
+
+    typedef MappedSnapshot<Key, Value> Snapshot;
+
+    std::string path_;
+    std::string tmpPath_;
+    int fd_;
+    SnapshotHeader header_;
+    uint64_t hash_;
+    std::vector<Key> fences_;
+    std::vector<item_type> batch_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the SnapshotWriter class.
+  ---------------------------------------------------
+*/
+
+/**
+* Creates the temporary file and reserves room for the header.
+*/
+template<typename Key, typename Value>
+SnapshotWriter<Key, Value>::SnapshotWriter(const std::string& path, uint32_t fenceStride) :
+    path_(path), tmpPath_(path + ".tmp"), fd_(-1), hash_(14695981039346656037ULL)
+{
+  fd_ = ::open(tmpPath_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error("cannot create " + tmpPath_);
+  }
+  std::memset(&header_, 0, sizeof(header_));
+  std::memcpy(header_.magic, "AVLSNAP", 8);
+  header_.version = Snapshot::VERSION;
+  header_.byteOrder = Snapshot::BYTE_ORDER_MARK;
+  header_.keySize = sizeof(Key);
+  header_.valueSize = sizeof(Value);
+  header_.entrySize = sizeof(item_type);
+  header_.fenceStride = fenceStride;
+  header_.entriesOffset = Snapshot::alignUp(sizeof(SnapshotHeader));
+  batch_.reserve(4096);
+
+  uint64_t ignored = 0;
+  std::vector<unsigned char> padding(header_.entriesOffset, 0);
+  try
+  {
+    Snapshot::writeAll(fd_, &padding[0], padding.size(), ignored);
+  }
+  catch (...)
+  {
+    ::close(fd_);
+    ::unlink(tmpPath_.c_str());
+    throw;
+  }
+}
+
+template<typename Key, typename Value>
+SnapshotWriter<Key, Value>::~SnapshotWriter()
+{
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    ::unlink(tmpPath_.c_str());
+  }
+}
+
+/**
+* Adds the next entry. Keys must be strictly increasing.
+*/
+template<typename Key, typename Value>
+void SnapshotWriter<Key, Value>::append(const Key& key, const Value& value)
+{
+  item_type entry;
+  //zero the padding so that the checksum is reproducible
+  std::memset(&entry, 0, sizeof(entry));
+  entry.first = key;
+  entry.second = value;
+  if (header_.fenceStride != 0 && header_.count % header_.fenceStride == 0)
+  {
+    fences_.push_back(key);
+  }
+  batch_.push_back(entry);
+  header_.count++;
+  if (batch_.size() == batch_.capacity())
+  {
+    flushBatch();
+  }
+}
+
+/**
+* The number of entries appended so far.
+*/
+template<typename Key, typename Value>
+size_t SnapshotWriter<Key, Value>::size() const
+{
+  return header_.count;
+}
+
+/**
+* Writes the fence index and header, syncs, and renames the file to path,
+* then syncs path's directory so that the rename itself survives a crash.
+*/
+template<typename Key, typename Value>
+void SnapshotWriter<Key, Value>::commit()
+{
+  flushBatch();
+  size_t entriesEnd = header_.entriesOffset + header_.count * sizeof(item_type);
+  header_.fencesOffset = Snapshot::alignUp(entriesEnd);
+  header_.fenceCount = fences_.size();
+  std::vector<unsigned char> padding(header_.fencesOffset - entriesEnd, 0);
+  if (!padding.empty())
+  {
+    Snapshot::writeAll(fd_, &padding[0], padding.size(), hash_);
+  }
+  if (!fences_.empty())
+  {
+    Snapshot::writeAll(fd_, &fences_[0], fences_.size() * sizeof(Key), hash_);
+  }
+
+  header_.checksum = hash_;
+  if (::pwrite(fd_, &header_, sizeof(header_), 0) != static_cast<ssize_t>(sizeof(header_)) || ::fsync(fd_) != 0)
+  {
+    throw std::runtime_error("cannot write " + tmpPath_);
+  }
+  ::close(fd_);
+  fd_ = -1;
+  if (::rename(tmpPath_.c_str(), path_.c_str()) != 0)
+  {
+    ::unlink(tmpPath_.c_str());
+    throw std::runtime_error("cannot rename " + tmpPath_ + " to " + path_);
+  }
+  size_t slash = path_.rfind('/');
+  std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path_.substr(0, slash));
+  int dirFd = ::open(dir.c_str(), O_RDONLY);
+  bool synced = dirFd >= 0 && ::fsync(dirFd) == 0;
+  if (dirFd >= 0)
+  {
+    ::close(dirFd);
+  }
+  if (!synced)
+  {
+    throw std::runtime_error("cannot sync " + dir);
+  }
+}
+
+template<typename Key, typename Value>
+void SnapshotWriter<Key, Value>::flushBatch()
+{
+  if (!batch_.empty())
+  {
+    Snapshot::writeAll(fd_, &batch_[0], batch_.size() * sizeof(item_type), hash_);
+    batch_.clear();
+  }
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the SnapshotWriter class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef SORTEDRUN_H
+#define SORTEDRUN_H
+
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/**
+* A fixed-capacity array of up to N key/value pairs kept sorted by key,
+* stored inline (no heap allocation). Items are std::pair<const Key, Value>
+* like the items of a Node, so references handed out through iterators
+* have the same type; shifting is done by destroying and re-constructing.
+*/
+template <typename Key, typename Value, size_t N>
+class SortedRun
+{
+public:
+    typedef std::pair<const Key, Value> item_type;
+
+    SortedRun();
+    ~SortedRun();
+    SortedRun(const SortedRun& other);
+    SortedRun(SortedRun&& other) noexcept(std::is_nothrow_move_constructible<item_type>::value);
+    SortedRun& operator=(const SortedRun& other);
+    SortedRun& operator=(SortedRun&& other) noexcept(std::is_nothrow_move_constructible<item_type>::value);
+
+    size_t size() const;
+    bool empty() const;
+    bool full() const;
+
+    size_t lowerBound(const Key& key) const;
+    size_t indexOf(const Key& key) const;
+    item_type& at(size_t index);
+    const item_type& at(size_t index) const;
+
+    void insertAt(size_t index, const item_type& item);
+    void eraseAt(size_t index);
+    void clear();
+
+protected:
+    item_type* slot(size_t index);
+    const item_type* slot(size_t index) const;
+
+    typename std::aligned_storage<sizeof(item_type), alignof(item_type)>::type items_[N];
+    size_t size_;
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the SortedRun class.
+  ----------------------------------------------
+*/
+
+template<typename Key, typename Value, size_t N>
+SortedRun<Key, Value, N>::SortedRun() :
+    size_(0)
+{
+
+}
+
+/**
+* Copies other's items into this run's own inline storage.
+*/
+template<typename Key, typename Value, size_t N>
+SortedRun<Key, Value, N>::SortedRun(const SortedRun& other) :
+    size_(0)
+{
+  try
+  {
+    for (; size_ < other.size_; size_++)
+    {
+      new (slot(size_)) item_type(*other.slot(size_));
+    }
+  }
+  catch (...)
+  {
+    clear();
+    throw;
+  }
+}
+
+/**
+* The items are inline, so they are moved one by one; other is left empty.
+*/
+template<typename Key, typename Value, size_t N>
+SortedRun<Key, Value, N>::SortedRun(SortedRun&& other) noexcept(std::is_nothrow_move_constructible<item_type>::value) :
+    size_(0)
+{
+  for (; size_ < other.size_; size_++)
+  {
+    new (slot(size_)) item_type(std::move(*other.slot(size_)));
+  }
+  other.clear();
+}
+
+template<typename Key, typename Value, size_t N>
+SortedRun<Key, Value, N>& SortedRun<Key, Value, N>::operator=(const SortedRun& other)
+{
+  if (this != &other)
+  {
+    clear();
+    for (; size_ < other.size_; size_++)
+    {
+      new (slot(size_)) item_type(*other.slot(size_));
+    }
+  }
+  return *this;
+}
+
+template<typename Key, typename Value, size_t N>
+SortedRun<Key, Value, N>& SortedRun<Key, Value, N>::operator=(SortedRun&& other)
+    noexcept(std::is_nothrow_move_constructible<item_type>::value)
+{
+  if (this != &other)
+  {
+    clear();
+    for (; size_ < other.size_; size_++)
+    {
+      new (slot(size_)) item_type(std::move(*other.slot(size_)));
+    }
+    other.clear();
+  }
+  return *this;
+}
+
+template<typename Key, typename Value, size_t N>
+SortedRun<Key, Value, N>::~SortedRun()
+{
+  clear();
+}
+
+template<typename Key, typename Value, size_t N>
+size_t SortedRun<Key, Value, N>::size() const
+{
+  return size_;
+}
+
+template<typename Key, typename Value, size_t N>
+bool SortedRun<Key, Value, N>::empty() const
+{
+  return size_ == 0;
+}
+
+template<typename Key, typename Value, size_t N>
+bool SortedRun<Key, Value, N>::full() const
+{
+  return size_ == N;
+}
+
+/**
+* Returns the index of the first item whose key is not less than key.
+* The scan has no early exit so that it compiles to a branch-free loop;
+* N is meant to be a handful of cache lines at most.
+*/
+template<typename Key, typename Value, size_t N>
+size_t SortedRun<Key, Value, N>::lowerBound(const Key& key) const
+{
+  size_t index = 0;
+  for (size_t i = 0; i < size_; i++)
+  {
+    index += (slot(i)->first < key) ? 1 : 0;
+  }
+  return index;
+}
+
+/**
+* Returns the index of the item with the given key, or size() if absent.
+*/
+template<typename Key, typename Value, size_t N>
+size_t SortedRun<Key, Value, N>::indexOf(const Key& key) const
+{
+  size_t index = lowerBound(key);
+  if (index < size_ && slot(index)->first == key)
+  {
+    return index;
+  }
+  return size_;
+}
+
+template<typename Key, typename Value, size_t N>
+typename SortedRun<Key, Value, N>::item_type& SortedRun<Key, Value, N>::at(size_t index)
+{
+  return *slot(index);
+}
+
+template<typename Key, typename Value, size_t N>
+const typename SortedRun<Key, Value, N>::item_type& SortedRun<Key, Value, N>::at(size_t index) const
+{
+  return *slot(index);
+}
+
+/**
+* Inserts item at index, shifting the items after it up by one.
+* @precondition !full() and index keeps the run sorted
+*/
+template<typename Key, typename Value, size_t N>
+void SortedRun<Key, Value, N>::insertAt(size_t index, const item_type& item)
+{
+  for (size_t i = size_; i > index; i--)
+  {
+    new (slot(i)) item_type(std::move(*slot(i - 1)));
+    slot(i - 1)->~item_type();
+  }
+  new (slot(index)) item_type(item);
+  size_++;
+}
+
+/**
+* Removes the item at index, shifting the items after it down by one.
+*/
+template<typename Key, typename Value, size_t N>
+void SortedRun<Key, Value, N>::eraseAt(size_t index)
+{
+  slot(index)->~item_type();
+  for (size_t i = index + 1; i < size_; i++)
+  {
+    new (slot(i - 1)) item_type(std::move(*slot(i)));
+    slot(i)->~item_type();
+  }
+  size_--;
+}
+
+template<typename Key, typename Value, size_t N>
+void SortedRun<Key, Value, N>::clear()
+{
+  for (size_t i = 0; i < size_; i++)
+  {
+    slot(i)->~item_type();
+  }
+  size_ = 0;
+}
+
+template<typename Key, typename Value, size_t N>
+typename SortedRun<Key, Value, N>::item_type* SortedRun<Key, Value, N>::slot(size_t index)
+{
+  return reinterpret_cast<item_type*>(&items_[index]);
+}
+
+template<typename Key, typename Value, size_t N>
+const typename SortedRun<Key, Value, N>::item_type* SortedRun<Key, Value, N>::slot(size_t index) const
+{
+  return reinterpret_cast<const item_type*>(&items_[index]);
+}
+
+/*
+  --------------------------------------------
+  End implementations for the SortedRun class.
+  --------------------------------------------
+*/
+
+#endif
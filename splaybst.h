@@ -0,0 +1,255 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include "bst.h"
+
+/**
+* A self-adjusting binary search tree. find, operator[], insert and remove
+* splay the accessed key to the root with a single top-down pass, so keys
+* that are accessed often stay within a few links of root_. Operations are
+* O(log n) amortized; under skewed access the hot keys cost far less.
+*
+* Since a lookup restructures the tree, find and operator[] are non-const
+* here. The const overloads search without splaying.
+*/
+template <class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    virtual void insert (const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+    iterator find(const Key& key);
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+protected:
+    // Add helper functions here
+    static Node<Key, Value>* splay(Node<Key, Value>* root, const Key& key);
+};
+
+/*
+ * If key is already in the tree, the current value is overwritten.
+ * Otherwise the new node becomes the root.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+{
+  if (this->root_ == nullptr)
+  {
+    this->root_ = new Node<Key, Value>(new_item.first, new_item.second, nullptr);
+    return;
+  }
+  Node<Key, Value>* root = splay(this->root_, new_item.first);
+  if (root->getKey() == new_item.first)
+  {
+    root->setValue(new_item.second);
+    this->root_ = root;
+    return;
+  }
+
+  Node<Key, Value>* temp = new Node<Key, Value>(new_item.first, new_item.second, nullptr);
+  if (new_item.first < root->getKey())
+  {
+    //root and its right subtree are greater than the new key
+    temp->setLeft(root->getLeft());
+    temp->setRight(root);
+    root->setLeft(nullptr);
+  }
+  else
+  {
+    temp->setRight(root->getRight());
+    temp->setLeft(root);
+    root->setRight(nullptr);
+  }
+  if (temp->getLeft() != nullptr)
+    temp->getLeft()->setParent(temp);
+  if (temp->getRight() != nullptr)
+    temp->getRight()->setParent(temp);
+  this->root_ = temp;
+}
+
+/*
+ * Splays key to the root, then joins its subtrees by splaying the largest
+ * key of the left subtree up and hanging the right subtree from it.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::remove(const Key& key)
+{
+  if (this->root_ == nullptr)
+  {
+    return;
+  }
+  Node<Key, Value>* root = splay(this->root_, key);
+  this->root_ = root;
+  if (!(root->getKey() == key))
+  {
+    return;
+  }
+
+  Node<Key, Value>* newRoot;
+  if (root->getLeft() == nullptr)
+  {
+    newRoot = root->getRight();
+  }
+  else
+  {
+    newRoot = root->getLeft();
+    newRoot->setParent(nullptr);
+    // every key on the left is smaller, so the maximum comes up with no right child
+    newRoot = splay(newRoot, key);
+    newRoot->setRight(root->getRight());
+  }
+  if (newRoot != nullptr)
+  {
+    newRoot->setParent(nullptr);
+    if (newRoot->getRight() != nullptr)
+      newRoot->getRight()->setParent(newRoot);
+  }
+  delete root;
+  this->root_ = newRoot;
+}
+
+/**
+* Splays key (or the last node on its search path) to the root and returns
+* an iterator to it, or end() if the key is absent.
+*/
+template<class Key, class Value>
+typename SplayTree<Key, Value>::iterator SplayTree<Key, Value>::find(const Key& key)
+{
+  if (this->root_ != nullptr)
+  {
+    this->root_ = splay(this->root_, key);
+  }
+  //the key, if present, is now at the root
+  return BinarySearchTree<Key, Value>::find(key);
+}
+
+/**
+* Searches without restructuring.
+*/
+template<class Key, class Value>
+typename SplayTree<Key, Value>::iterator SplayTree<Key, Value>::find(const Key& key) const
+{
+  return BinarySearchTree<Key, Value>::find(key);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& SplayTree<Key, Value>::operator[](const Key& key)
+{
+  iterator it = find(key);
+  if(it == this->end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+template<class Key, class Value>
+Value const & SplayTree<Key, Value>::operator[](const Key& key) const
+{
+  return BinarySearchTree<Key, Value>::operator[](key);
+}
+
+/**
+* Top-down splay of the subtree at root (which must have no parent).
+* Nodes passed on the way down are hung off a left tree (keys below key)
+* and a right tree (keys above), which are then attached under the final
+* node. Returns the new subtree root, whose parent is nullptr.
+*/
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::splay(Node<Key, Value>* root, const Key& key)
+{
+  Node<Key, Value>* leftRoot = nullptr;
+  Node<Key, Value>* leftMax = nullptr;
+  Node<Key, Value>* rightRoot = nullptr;
+  Node<Key, Value>* rightMin = nullptr;
+  Node<Key, Value>* currNode = root;
+
+  while (true)
+  {
+    if (key < currNode->getKey())
+    {
+      Node<Key, Value>* child = currNode->getLeft();
+      if (child == nullptr)
+        break;
+      if (key < child->getKey())
+      {
+        //zig-zig: rotate right before linking
+        currNode->setLeft(child->getRight());
+        if (currNode->getLeft() != nullptr)
+          currNode->getLeft()->setParent(currNode);
+        child->setRight(currNode);
+        currNode->setParent(child);
+        currNode = child;
+        if (currNode->getLeft() == nullptr)
+          break;
+      }
+      //link currNode as the new minimum of the right tree
+      if (rightMin == nullptr)
+        rightRoot = currNode;
+      else
+        rightMin->setLeft(currNode);
+      currNode->setParent(rightMin);
+      rightMin = currNode;
+      currNode = currNode->getLeft();
+    }
+    else if (currNode->getKey() < key)
+    {
+      Node<Key, Value>* child = currNode->getRight();
+      if (child == nullptr)
+        break;
+      if (child->getKey() < key)
+      {
+        //zag-zag: rotate left before linking
+        currNode->setRight(child->getLeft());
+        if (currNode->getRight() != nullptr)
+          currNode->getRight()->setParent(currNode);
+        child->setLeft(currNode);
+        currNode->setParent(child);
+        currNode = child;
+        if (currNode->getRight() == nullptr)
+          break;
+      }
+      //link currNode as the new maximum of the left tree
+      if (leftMax == nullptr)
+        leftRoot = currNode;
+      else
+        leftMax->setRight(currNode);
+      currNode->setParent(leftMax);
+      leftMax = currNode;
+      currNode = currNode->getRight();
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  //assemble
+  if (leftMax != nullptr)
+  {
+    leftMax->setRight(currNode->getLeft());
+    if (leftMax->getRight() != nullptr)
+      leftMax->getRight()->setParent(leftMax);
+    currNode->setLeft(leftRoot);
+    leftRoot->setParent(currNode);
+  }
+  if (rightMin != nullptr)
+  {
+    rightMin->setLeft(currNode->getRight());
+    if (rightMin->getLeft() != nullptr)
+      rightMin->getLeft()->setParent(rightMin);
+    currNode->setRight(rightRoot);
+    rightRoot->setParent(currNode);
+  }
+  currNode->setParent(nullptr);
+  return currNode;
+}
+
+#endif
@@ -0,0 +1,680 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "avlbst.h"
+#include "snapshot.h"
+
+/**
+* An append-only log of insert and remove operations on an AVLTree.
+*
+* Each record is one op byte, the key, the value (inserts only) and a
+* 32-bit FNV-1a checksum of those bytes, after a 16-byte file header.
+* append() only buffers a record and returns its sequence number;
+* sync(seq) returns once that record is on disk. Whichever caller of
+* sync() finds no write in progress becomes the leader: it takes
+* everything buffered so far, from every thread, and writes it with one
+* write() and one fdatasync(). Callers arriving meanwhile wait for the
+* next round, so under concurrency many records share one sync (group
+* commit).
+*
+* replay() applies the log to a tree and truncates a torn tail left by a
+* crash. Key and Value must be trivially copyable.
+*/
+template <typename Key, typename Value>
+class WriteAheadLog
+{
+public:
+    enum Op { INSERT = 1, REMOVE = 2 };
+
+    explicit WriteAheadLog(const std::string& path);
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    uint64_t append(Op op, const Key& key, const Value& value);
+    void sync(uint64_t seq);
+    void logInsert(const Key& key, const Value& value);
+    void logRemove(const Key& key);
+
+    size_t replay(AVLTree<Key, Value>& tree);
+    void truncate();
+
+    uint64_t bytes() const;
+    uint64_t syncCount() const;
+
+protected:
+    static const size_t HEADER_SIZE = 16;
+    static const size_t CHECKSUM_SIZE = sizeof(uint32_t);
+    // records replayed per sorted batch
+    static const size_t REPLAY_BATCH = 1 << 18;
+
+    struct Record
+    {
+        Key key;
+        Value value;
+        Op op;
+    };
+    static bool keyLess(const Record& a, const Record& b);
+    static void applyBatch(AVLTree<Key, Value>& tree, std::vector<Record>& batch);
+
+    static uint32_t checksum(const char* data, size_t length);
+    static size_t recordSize(Op op);
+    void writeHeader();
+
+    std::string path_;
+    int fd_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable synced_;
+    std::string buffer_;      // records appended but not yet handed to a leader
+    uint64_t appended_;       // sequence number of the last appended record
+    uint64_t durable_;        // sequence number of the last record on disk
+    uint64_t fileBytes_;      // on disk plus buffered
+    uint64_t syncs_;
+    bool leaderActive_;
+    bool failed_;
+
+    static_assert(std::is_trivially_copyable<Key>::value, "logged keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "logged values must be trivially copyable");
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the WriteAheadLog class.
+  ---------------------------------------------------
+*/
+
+/**
+* Opens the log at path for appending, creating it if needed. Throws
+* std::runtime_error if it cannot be opened or belongs to another
+* Key/Value layout.
+*/
+template<typename Key, typename Value>
+WriteAheadLog<Key, Value>::WriteAheadLog(const std::string& path) :
+    path_(path), fd_(-1), appended_(0), durable_(0), fileBytes_(0), syncs_(0),
+    leaderActive_(false), failed_(false)
+{
+  fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error("cannot open " + path_);
+  }
+  struct stat st;
+  if (::fstat(fd_, &st) != 0)
+  {
+    ::close(fd_);
+    throw std::runtime_error("cannot stat " + path_);
+  }
+  if (st.st_size == 0)
+  {
+    writeHeader();
+    return;
+  }
+  char header[HEADER_SIZE];
+  uint32_t sizes[2];
+  if (::pread(fd_, header, HEADER_SIZE, 0) != static_cast<ssize_t>(HEADER_SIZE)
+      || std::memcmp(header, "AVLWAL", 7) != 0)
+  {
+    ::close(fd_);
+    throw std::runtime_error(path_ + " is not an operation log");
+  }
+  std::memcpy(sizes, header + 8, sizeof(sizes));
+  if (sizes[0] != sizeof(Key) || sizes[1] != sizeof(Value))
+  {
+    ::close(fd_);
+    throw std::runtime_error(path_ + " was written for other key/value types");
+  }
+  fileBytes_ = st.st_size;
+  ::lseek(fd_, 0, SEEK_END);
+}
+
+/**
+* Writes out anything still buffered, then closes the log.
+*/
+template<typename Key, typename Value>
+WriteAheadLog<Key, Value>::~WriteAheadLog()
+{
+  try
+  {
+    sync(appended_);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "WriteAheadLog: final sync failed: " << e.what() << std::endl;
+  }
+  ::close(fd_);
+}
+
+/**
+* Buffers a record and returns its sequence number for sync(). The value
+* is ignored for REMOVE.
+*/
+template<typename Key, typename Value>
+uint64_t WriteAheadLog<Key, Value>::append(Op op, const Key& key, const Value& value)
+{
+  char record[1 + sizeof(Key) + sizeof(Value) + CHECKSUM_SIZE];
+  size_t length = recordSize(op) - CHECKSUM_SIZE;
+  record[0] = static_cast<char>(op);
+  std::memcpy(record + 1, &key, sizeof(Key));
+  if (op == INSERT)
+  {
+    std::memcpy(record + 1 + sizeof(Key), &value, sizeof(Value));
+  }
+  uint32_t sum = checksum(record, length);
+  std::memcpy(record + length, &sum, CHECKSUM_SIZE);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffer_.append(record, length + CHECKSUM_SIZE);
+  fileBytes_ += length + CHECKSUM_SIZE;
+  return ++appended_;
+}
+
+/**
+* Returns once record seq and every record before it are on disk,
+* writing them itself if no other thread is already doing so. Throws
+* std::runtime_error if the log could not be written.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::sync(uint64_t seq)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (durable_ < seq)
+  {
+    if (failed_)
+    {
+      throw std::runtime_error("cannot write " + path_);
+    }
+    if (leaderActive_)
+    {
+      synced_.wait(lock);
+      continue;
+    }
+    //become the leader for everything buffered so far
+    leaderActive_ = true;
+    std::string batch;
+    batch.swap(buffer_);
+    uint64_t upTo = appended_;
+    lock.unlock();
+
+    const char* data = batch.data();
+    size_t length = batch.size();
+    bool ok = true;
+    while (ok && length > 0)
+    {
+      ssize_t written = ::write(fd_, data, length);
+      if (written < 0 && errno == EINTR)
+        continue;
+      ok = (written > 0);
+      if (ok)
+      {
+        data += written;
+        length -= written;
+      }
+    }
+    ok = ok && ::fdatasync(fd_) == 0;
+
+    lock.lock();
+    leaderActive_ = false;
+    failed_ = !ok;
+    if (ok)
+    {
+      durable_ = upTo;
+      syncs_++;
+    }
+    synced_.notify_all();
+  }
+}
+
+/**
+* Logs an insert and returns once it is durable.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::logInsert(const Key& key, const Value& value)
+{
+  sync(append(INSERT, key, value));
+}
+
+/**
+* Logs a remove and returns once it is durable.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::logRemove(const Key& key)
+{
+  sync(append(REMOVE, key, Value()));
+}
+
+/**
+* Applies every record in the log to tree and returns how many there
+* were. Records are applied in batches of REPLAY_BATCH, each sorted by
+* key with only the last record per key kept (see applyBatch), so that
+* their inserts can be merged in as one sorted batch. Replay stops at the
+* first incomplete or corrupt record, which can only be the tail of a
+* write interrupted by a crash, and truncates it away.
+* Throws std::runtime_error if the log cannot be read. Call before
+* appending.
+*/
+template<typename Key, typename Value>
+size_t WriteAheadLog<Key, Value>::replay(AVLTree<Key, Value>& tree)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Record> batch;
+  batch.reserve(REPLAY_BATCH);
+  size_t applied = 0;
+  uint64_t chunkStart = HEADER_SIZE;   // file offset of chunk[0]
+  std::vector<char> chunk(1 << 20);
+  size_t have = 0;
+  size_t pos = 0;
+  bool torn = false;
+  while (!torn)
+  {
+    //carry a partial record at the end of the chunk over to the next read
+    std::memmove(chunk.data(), chunk.data() + pos, have - pos);
+    chunkStart += pos;
+    have -= pos;
+    pos = 0;
+    ssize_t got = ::pread(fd_, chunk.data() + have, chunk.size() - have, chunkStart + have);
+    if (got < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (got < 0)
+    {
+      throw std::runtime_error("cannot read " + path_);
+    }
+    if (got == 0)
+    {
+      torn = (have != 0);
+      break;
+    }
+    have += got;
+    while (pos < have)
+    {
+      const char* record = chunk.data() + pos;
+      Op op = static_cast<Op>(record[0]);
+      if (op != INSERT && op != REMOVE)
+      {
+        torn = true;
+        break;
+      }
+      size_t length = recordSize(op);
+      if (pos + length > have)
+      {
+        break;
+      }
+      uint32_t sum;
+      std::memcpy(&sum, record + length - CHECKSUM_SIZE, CHECKSUM_SIZE);
+      if (sum != checksum(record, length - CHECKSUM_SIZE))
+      {
+        torn = true;
+        break;
+      }
+      Record parsed;
+      parsed.op = op;
+      std::memcpy(&parsed.key, record + 1, sizeof(Key));
+      if (op == INSERT)
+      {
+        std::memcpy(&parsed.value, record + 1 + sizeof(Key), sizeof(Value));
+      }
+      batch.push_back(parsed);
+      if (batch.size() == REPLAY_BATCH)
+      {
+        applyBatch(tree, batch);
+      }
+      applied++;
+      pos += length;
+    }
+  }
+  applyBatch(tree, batch);
+
+  uint64_t end = chunkStart + pos;
+  if (torn && ::ftruncate(fd_, end) != 0)
+  {
+    throw std::runtime_error("cannot truncate " + path_);
+  }
+  fileBytes_ = end;
+  ::lseek(fd_, end, SEEK_SET);
+  return applied;
+}
+
+/**
+* Empties the log, once every record appended so far is covered by a
+* checkpoint; those records count as durable from then on.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::truncate()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (leaderActive_)
+  {
+    synced_.wait(lock);
+  }
+  if (::ftruncate(fd_, 0) != 0)
+  {
+    throw std::runtime_error("cannot truncate " + path_);
+  }
+  ::lseek(fd_, 0, SEEK_SET);
+  buffer_.clear();
+  durable_ = appended_;
+  writeHeader();
+  synced_.notify_all();
+}
+
+/**
+* The size of the log, including records not yet synced.
+*/
+template<typename Key, typename Value>
+uint64_t WriteAheadLog<Key, Value>::bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fileBytes_;
+}
+
+/**
+* The number of fdatasync calls so far; with group commit it can be far
+* below the number of records.
+*/
+template<typename Key, typename Value>
+uint64_t WriteAheadLog<Key, Value>::syncCount() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return syncs_;
+}
+
+/**
+* Applies a batch of records in key order and empties it. Operations on
+* different keys commute, and only the last one on each key matters, so
+* this ends in the same tree as applying them in log order. The inserts
+* that survive are strictly increasing and go in with one insertSorted.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::applyBatch(AVLTree<Key, Value>& tree, std::vector<Record>& batch)
+{
+  std::stable_sort(batch.begin(), batch.end(), keyLess);
+  std::vector<std::pair<Key, Value> > inserts;
+  inserts.reserve(batch.size());
+  for (size_t i = 0; i < batch.size(); i++)
+  {
+    if (i + 1 < batch.size() && batch[i + 1].key == batch[i].key)
+    {
+      continue;
+    }
+    if (batch[i].op == INSERT)
+    {
+      inserts.push_back(std::make_pair(batch[i].key, batch[i].value));
+    }
+    else
+    {
+      tree.remove(batch[i].key);
+    }
+  }
+  tree.insertSorted(inserts.begin(), inserts.end());
+  batch.clear();
+}
+
+template<typename Key, typename Value>
+bool WriteAheadLog<Key, Value>::keyLess(const Record& a, const Record& b)
+{
+  return a.key < b.key;
+}
+
+template<typename Key, typename Value>
+uint32_t WriteAheadLog<Key, Value>::checksum(const char* data, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+template<typename Key, typename Value>
+size_t WriteAheadLog<Key, Value>::recordSize(Op op)
+{
+  return 1 + sizeof(Key) + (op == INSERT ? sizeof(Value) : 0) + CHECKSUM_SIZE;
+}
+
+/**
+* Writes the header of an empty log: magic, key size and value size.
+*/
+template<typename Key, typename Value>
+void WriteAheadLog<Key, Value>::writeHeader()
+{
+  char header[HEADER_SIZE];
+  std::memset(header, 0, HEADER_SIZE);
+  std::memcpy(header, "AVLWAL", 7);
+  uint32_t sizes[2] = { static_cast<uint32_t>(sizeof(Key)), static_cast<uint32_t>(sizeof(Value)) };
+  std::memcpy(header + 8, sizes, sizeof(sizes));
+  if (::write(fd_, header, HEADER_SIZE) != static_cast<ssize_t>(HEADER_SIZE) || ::fdatasync(fd_) != 0)
+  {
+    throw std::runtime_error("cannot write " + path_);
+  }
+  fileBytes_ = HEADER_SIZE;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the WriteAheadLog class.
+  -------------------------------------------------
+*/
+
+/**
+* An AVLTree made durable by a WriteAheadLog, kept with a checkpoint in a
+* directory. Every insert and remove is logged and applied under one
+* lock, so the log order is the tree order, and returns once its record
+* is durable; concurrent writers share syncs through group commit.
+* Changes become visible to lookup() as soon as they are applied, which
+* may be just before they are durable.
+*
+* When the log outgrows checkpointBytes the tree is saved as a snapshot
+* (written aside and renamed into place) and the log is emptied, so that
+* recovery, which loads the checkpoint and replays the log, stays short.
+* A crash between the two only means the log is replayed over a
+* checkpoint that already holds it, which inserts and removes the same
+* keys again to the same end result.
+*/
+template <typename Key, typename Value>
+class LoggedAVLTree
+{
+public:
+    static const uint64_t DEFAULT_CHECKPOINT_BYTES = 64 << 20;
+
+    explicit LoggedAVLTree(const std::string& dir, uint64_t checkpointBytes = DEFAULT_CHECKPOINT_BYTES);
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool lookup(const Key& key, Value& value) const;
+    size_t size() const;
+    void checkpoint();
+
+    size_t replayedRecords() const;
+    const WriteAheadLog<Key, Value>& log() const;
+
+protected:
+    static std::string makeDir(const std::string& dir);
+    void checkpointIfDue();
+    void saveCheckpoint();
+
+    std::string dir_;
+    uint64_t checkpointBytes_;
+    mutable std::mutex mutex_;
+    AVLTree<Key, Value> tree_;
+    WriteAheadLog<Key, Value> log_;
+    size_t replayed_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the LoggedAVLTree class.
+  ---------------------------------------------------
+*/
+
+/**
+* Opens or creates the tree in dir and recovers it: the checkpoint, if
+* any, is loaded and then the log is replayed over it.
+*/
+template<typename Key, typename Value>
+LoggedAVLTree<Key, Value>::LoggedAVLTree(const std::string& dir, uint64_t checkpointBytes) :
+    dir_(makeDir(dir)), checkpointBytes_(checkpointBytes), log_(dir_ + "/wal.log"), replayed_(0)
+{
+  std::string checkpointPath = dir_ + "/checkpoint.snap";
+  if (::access(checkpointPath.c_str(), F_OK) == 0)
+  {
+    MappedSnapshot<Key, Value> snapshot;
+    snapshot.load(checkpointPath);
+    //entries arrive in key order, so the tree is linked up in one pass
+    tree_.insertSorted(snapshot.begin(), snapshot.end());
+  }
+  replayed_ = log_.replay(tree_);
+}
+
+/**
+* If key is already in the tree, the current value is overwritten.
+* Returns once the change is durable.
+*/
+template<typename Key, typename Value>
+void LoggedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seq = log_.append(WriteAheadLog<Key, Value>::INSERT, keyValuePair.first, keyValuePair.second);
+    tree_.insert(keyValuePair);
+  }
+  log_.sync(seq);
+  checkpointIfDue();
+}
+
+/**
+* Removes the key if it exists. Returns once the change is durable.
+*/
+template<typename Key, typename Value>
+void LoggedAVLTree<Key, Value>::remove(const Key& key)
+{
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seq = log_.append(WriteAheadLog<Key, Value>::REMOVE, key, Value());
+    tree_.remove(key);
+  }
+  log_.sync(seq);
+  checkpointIfDue();
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false
+* if the key is absent.
+*/
+template<typename Key, typename Value>
+bool LoggedAVLTree<Key, Value>::lookup(const Key& key, Value& value) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  typename AVLTree<Key, Value>::iterator it = tree_.find(key);
+  if (it == tree_.end())
+  {
+    return false;
+  }
+  value = it->second;
+  return true;
+}
+
+template<typename Key, typename Value>
+size_t LoggedAVLTree<Key, Value>::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tree_.size();
+}
+
+/**
+* Saves the tree as the new checkpoint and empties the log. Writers wait
+* for it to finish. Writers still waiting for a sync are released by the
+* truncate, since the checkpoint already holds their changes.
+*/
+template<typename Key, typename Value>
+void LoggedAVLTree<Key, Value>::checkpoint()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  saveCheckpoint();
+}
+
+/**
+* The number of log records applied when the tree was opened.
+*/
+template<typename Key, typename Value>
+size_t LoggedAVLTree<Key, Value>::replayedRecords() const
+{
+  return replayed_;
+}
+
+template<typename Key, typename Value>
+const WriteAheadLog<Key, Value>& LoggedAVLTree<Key, Value>::log() const
+{
+  return log_;
+}
+
+template<typename Key, typename Value>
+std::string LoggedAVLTree<Key, Value>::makeDir(const std::string& dir)
+{
+  if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    throw std::runtime_error("cannot create " + dir);
+  }
+  return dir;
+}
+
+/**
+* Checkpoints if the log has outgrown checkpointBytes. Several writers may
+* notice at once; only the first one checkpoints.
+*/
+template<typename Key, typename Value>
+void LoggedAVLTree<Key, Value>::checkpointIfDue()
+{
+  if (log_.bytes() <= checkpointBytes_)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (log_.bytes() > checkpointBytes_)
+  {
+    saveCheckpoint();
+  }
+}
+
+/**
+* Writes the checkpoint and empties the log; the caller holds mutex_. The
+* log may only go once the checkpoint's rename has reached the disk, or a
+* crash could leave the old checkpoint with an empty log; save() returns
+* only after syncing the directory.
+*/
+template<typename Key, typename Value>
+void LoggedAVLTree<Key, Value>::saveCheckpoint()
+{
+  MappedSnapshot<Key, Value>::save(tree_, dir_ + "/checkpoint.snap", 0);
+  log_.truncate();
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the LoggedAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif